@@ -0,0 +1,75 @@
+//
+//  Arena.h
+//  silk
+//
+//  Created by Haohui Mai on 12/23/12.
+//  Copyright (c) 2012 Haohui Mai. All rights reserved.
+//
+
+#ifndef SILK_SUPPORT_ARENA_H_
+#define SILK_SUPPORT_ARENA_H_
+
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace silk
+{
+    //
+    // A bump-pointer allocator. Objects are carved out of large chunks and
+    // are released all at once, either when the arena is destroyed or when
+    // it is reset. Objects with non-trivial destructors are destroyed in
+    // the reverse order of their creation.
+    //
+    // Allocations are serialized by a lock, thus lazily created objects can
+    // come from several threads.
+    //
+    class Arena
+    {
+    public:
+        explicit Arena(size_t chunk_size = 4096);
+        ~Arena();
+
+        void *Allocate(size_t size, size_t align);
+
+        template <class T, class... Args>
+        T *New(Args&&... args)
+        {
+            void *p = Allocate(sizeof(T), alignof(T));
+            T *obj = new (p) T(std::forward<Args>(args)...);
+            if (!std::is_trivially_destructible<T>::value)
+                AddDestructor(obj, &Destroy<T>);
+            return obj;
+        }
+
+        // Destroys the objects and releases the memory of the arena
+        void Reset();
+        // Number of bytes handed out since the last reset
+        size_t allocated() const { return allocated_; }
+
+    private:
+        Arena(const Arena &) = delete;
+        Arena &operator=(const Arena &) = delete;
+
+        template <class T>
+        static void Destroy(void *p)
+        { static_cast<T*>(p)->~T(); }
+        void AddDestructor(void *obj, void (*dtor)(void*));
+        void ResetLocked();
+
+        typedef std::pair<void*, void (*)(void*)> Destructor;
+
+        size_t chunk_size_;
+        char *cur_;
+        char *end_;
+        size_t allocated_;
+        std::vector<char*> chunks_;
+        std::vector<Destructor> destructors_;
+        std::mutex lock_;
+    };
+}
+
+#endif
@@ -0,0 +1,62 @@
+//
+//  Atom.h
+//  silk
+//
+//  Created by Haohui Mai on 12/20/12.
+//  Copyright (c) 2012 Haohui Mai. All rights reserved.
+//
+
+#ifndef SILK_SUPPORT_ATOM_H_
+#define SILK_SUPPORT_ATOM_H_
+
+#include <string>
+#include <functional>
+
+namespace silk
+{
+    //
+    // An Atom is a handle to a string stored in a process-wide intern
+    // table. Each distinct string is hashed and copied once, when it is
+    // first interned. After that atoms compare and hash by pointer, so
+    // they can be used as cheap keys for names of types and members.
+    //
+    // The intern table is never freed, thus the handles remain valid for
+    // the lifetime of the process.
+    //
+    class Atom
+    {
+    public:
+        Atom()
+        : str_(nullptr)
+        {}
+        explicit Atom(const std::u16string &s);
+        explicit Atom(const char16_t *s);
+
+        const std::u16string &str() const;
+        bool empty() const
+        { return !str_; }
+        size_t hash() const
+        { return std::hash<const std::u16string*>()(str_); }
+
+        bool operator==(const Atom &rhs) const
+        { return str_ == rhs.str_; }
+        bool operator!=(const Atom &rhs) const
+        { return str_ != rhs.str_; }
+
+    private:
+        // nullptr represents the empty string
+        const std::u16string *str_;
+    };
+}
+
+namespace std
+{
+    template<>
+    struct hash<silk::Atom>
+    {
+        size_t operator()(const silk::Atom &v) const
+        { return v.hash(); }
+    };
+}
+
+#endif
@@ -0,0 +1,68 @@
+//
+//  ConcurrentMap.h
+//  silk
+//
+//  Created by Haohui Mai on 12/30/12.
+//  Copyright (c) 2012 Haohui Mai. All rights reserved.
+//
+
+#ifndef SILK_SUPPORT_CONCURRENT_MAP_H_
+#define SILK_SUPPORT_CONCURRENT_MAP_H_
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+
+namespace silk
+{
+    //
+    // A hash map that is split into shards with a lock of their own, thus
+    // threads that look up different keys rarely wait for each other. The
+    // values are returned by copy, since an entry can be overwritten as
+    // soon as the lock of its shard is released.
+    //
+    template <class Key, class Value, class Hash = std::hash<Key> >
+    class ConcurrentMap
+    {
+    public:
+        bool Lookup(const Key &key, Value *value) const
+        {
+            auto &shard = GetShard(key);
+            std::lock_guard<std::mutex> guard(shard.lock);
+            auto it = shard.map.find(key);
+            if (it == shard.map.end())
+                return false;
+            *value = it->second;
+            return true;
+        }
+
+        void Insert(const Key &key, const Value &value)
+        {
+            auto &shard = GetShard(key);
+            std::lock_guard<std::mutex> guard(shard.lock);
+            shard.map[key] = value;
+        }
+
+    private:
+        enum { kShardBits = 4, kShardCount = 1 << kShardBits };
+        struct Shard
+        {
+            mutable std::mutex lock;
+            std::unordered_map<Key, Value, Hash> map;
+        };
+
+        // The top bits of the mixed hash, the buckets of each shard use
+        // the low bits.
+        static size_t ShardIndex(const Key &key)
+        { return (uint64_t(Hash()(key)) * 0x9e3779b97f4a7c15ULL) >> (64 - kShardBits); }
+        Shard &GetShard(const Key &key)
+        { return shards_[ShardIndex(key)]; }
+        const Shard &GetShard(const Key &key) const
+        { return shards_[ShardIndex(key)]; }
+
+        Shard shards_[kShardCount];
+    };
+}
+
+#endif
@@ -9,12 +9,29 @@
 #ifndef SILK_SUPPORT_ERROR_HANDLER_H_
 #define SILK_SUPPORT_ERROR_HANDLER_H_
 
+#include <atomic>
+#include <cstdarg>
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
 namespace silk
 {
+    //
+    // The handler can be shared by several threads. Each message is
+    // printed as a whole, but the order of the messages from different
+    // threads depends on the scheduling unless they are deferred, see
+    // DeferredScope.
+    //
     class ErrorHandler
     {
     public:
-        ErrorHandler();
+        // A quiet handler only records whether an error has happened
+        explicit ErrorHandler(bool quiet = false);
         bool has_error() const { return has_error_; }
         void set_error() { has_error_ = true; }
         void clear_error() { has_error_ = false; }
@@ -22,8 +39,40 @@ namespace silk
         void __attribute__((format(printf, 2, 3))) Info(const char *fmt, ...);
         void __attribute__((format(printf, 2, 3))) Warn(const char *fmt, ...);
         void __attribute__((format(printf, 2, 3))) Error(const char *fmt, ...);
+        
+        //
+        // Collects the messages that the current thread reports while the
+        // scope is alive. The messages of all scopes are printed by
+        // FlushDeferred() in the order of their keys, thus the output of
+        // a parallel loop does not depend on which thread ran which part
+        // of it, as long as each part uses its own key.
+        //
+        class DeferredScope
+        {
+        public:
+            DeferredScope(ErrorHandler &eh, size_t key);
+            ~DeferredScope();
+        private:
+            DeferredScope(const DeferredScope &) = delete;
+            DeferredScope &operator=(const DeferredScope &) = delete;
+            friend class ErrorHandler;
+            ErrorHandler &eh_;
+            size_t key_;
+            DeferredScope *outer_;
+            std::vector<std::string> messages_;
+        };
+        void FlushDeferred();
+        
     private:
-        int has_error_;        
+        ErrorHandler(const ErrorHandler &) = delete;
+        ErrorHandler &operator=(const ErrorHandler &) = delete;
+        void Report(const char *type, const char *fmt, va_list args);
+        
+        std::atomic<bool> has_error_;
+        bool quiet_;
+        std::mutex lock_;
+        std::unordered_map<std::thread::id, DeferredScope*> deferred_scopes_;
+        std::multimap<size_t, std::string> deferred_messages_;
     };
 }
 
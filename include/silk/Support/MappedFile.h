@@ -0,0 +1,85 @@
+//
+//  MappedFile.h
+//  silk
+//
+//  Created by Haohui Mai on 12/21/12.
+//  Copyright (c) 2012 Haohui Mai. All rights reserved.
+//
+
+#ifndef SILK_SUPPORT_MAPPED_FILE_H_
+#define SILK_SUPPORT_MAPPED_FILE_H_
+
+#include <string>
+#include <cstddef>
+#include <ctime>
+
+namespace silk
+{
+    class ErrorHandler;
+
+    //
+    // A read-only, shared memory mapping of a file. The pages are backed by
+    // the page cache directly, thus several processes that map the same
+    // assembly share a single copy of it.
+    //
+    // Regions of the mapping can be advised individually, which allows the
+    // reader to tell the kernel how each part of the file is going to be
+    // accessed.
+    //
+    class MappedFile
+    {
+    public:
+        enum class Advice
+        {
+            kNormal,
+            kSequential,
+            kRandom,
+            kWillNeed,
+        };
+
+        // Returns nullptr and reports through eh if the file cannot be mapped
+        static MappedFile *Open(const std::string &path, ErrorHandler &eh);
+        ~MappedFile();
+
+        const char *start() const { return start_; }
+        size_t size() const { return size_; }
+        const std::string &path() const { return path_; }
+        // Modification time of the file when it was mapped
+        time_t mtime() const { return mtime_; }
+
+        // The region is widened to page boundaries. Regions outside of the
+        // mapping are clipped.
+        void Advise(const char *begin, size_t length, Advice advice) const;
+        void Advise(Advice advice) const
+        { Advise(start_, size_, advice); }
+
+    private:
+        MappedFile(const std::string &path, const char *start, size_t size, time_t mtime);
+        MappedFile(const MappedFile &) = delete;
+        MappedFile &operator=(const MappedFile &) = delete;
+
+        std::string path_;
+        const char *start_;
+        size_t size_;
+        time_t mtime_;
+    };
+
+    //
+    // Writes the file aside and renames it over path, thus readers that
+    // map the file concurrently never see a partial one. Returns false
+    // and leaves errno set on failure.
+    //
+    bool WriteFileAtomically(const std::string &path, const char *data, size_t size);
+
+    //
+    // Page faults taken by the current process so far.
+    //
+    struct PageFaultCount
+    {
+        long minor;
+        long major;
+        static PageFaultCount Current();
+    };
+}
+
+#endif
@@ -0,0 +1,65 @@
+//
+//  ThreadPool.h
+//  silk
+//
+//  Created by Haohui Mai on 12/22/12.
+//  Copyright (c) 2012 Haohui Mai. All rights reserved.
+//
+
+#ifndef SILK_SUPPORT_THREAD_POOL_H_
+#define SILK_SUPPORT_THREAD_POOL_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace silk
+{
+    //
+    // A fixed set of worker threads that run tasks in FIFO order. Tasks
+    // may schedule further tasks, but they must not wait for each other.
+    //
+    // The destructor runs the tasks that are still queued before joining
+    // the workers.
+    //
+    class ThreadPool
+    {
+    public:
+        // Uses one worker per hardware thread when threads is 0
+        explicit ThreadPool(unsigned threads = 0);
+        ~ThreadPool();
+
+        void Async(std::function<void()> task);
+        // Blocks until the queue is empty and all workers are idle
+        void Wait();
+        
+        //
+        // Calls body(begin, end) over [0, count) in chunks of grain
+        // elements. Idle workers and the calling thread take the next chunk
+        // as soon as they finish one, so uneven chunks balance out. Returns
+        // when every chunk is done; it only waits for the chunks that are
+        // running, thus it can be called from a task as well.
+        //
+        void ParallelFor(size_t count, size_t grain,
+                         const std::function<void(size_t, size_t)> &body);
+        unsigned size() const { return workers_.size(); }
+
+    private:
+        ThreadPool(const ThreadPool &) = delete;
+        ThreadPool &operator=(const ThreadPool &) = delete;
+        void Run();
+
+        std::vector<std::thread> workers_;
+        std::deque<std::function<void()> > tasks_;
+        std::mutex lock_;
+        std::condition_variable queue_cond_;
+        std::condition_variable idle_cond_;
+        unsigned active_;
+        bool stopping_;
+    };
+}
+
+#endif
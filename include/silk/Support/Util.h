@@ -15,6 +15,7 @@ namespace silk
 {
     std::string ToUTF8String(const std::u16string &s);
     std::u16string ToUTF16String(const std::string &s);
+    std::u16string ToUTF16String(const char *s, size_t length);
 }
 
 
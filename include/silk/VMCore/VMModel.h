@@ -10,11 +10,13 @@
 #define SILK_VMCORE_VMMODEL_H_
 
 #include <string>
+#include <vector>
 
 namespace llvm
 {
     class Module;
     class Function;
+    class LLVMContext;
 }
 
 namespace silk
@@ -22,6 +24,7 @@ namespace silk
     namespace decil
     {
         class IHost;
+        class IAssembly;
     }
     
     class IIntrinsic;
@@ -33,7 +36,34 @@ namespace silk
         virtual llvm::Module *module() = 0;
         virtual decil::IHost *host() = 0;
         virtual IIntrinsic *intrinsic() const = 0;
+        // The engine takes the ownership of the intrinsic
         virtual void set_intrinsic(IIntrinsic *intrinsic) = 0;
+        //
+        // Compiles the methods into the given number of module shards on
+        // the given number of threads (0 for one per core), and links the
+        // shards into module() at the end. The methods are assigned to the
+        // shards independently of the threads, thus the output only
+        // depends on the number of shards. Every shard uses the AOT
+        // intrinsics.
+        //
+        virtual void SetParallelCodegen(unsigned shards, unsigned threads) = 0;
+        // Reuses the code of the methods that have not changed since the
+        // compilations that stored it in dir
+        virtual void SetCodeCache(const std::string &dir) = 0;
+        //
+        // Only compiles the methods that are reachable from the entry point
+        // of the program and from the roots, see lib/VMCore/Reachability.h.
+        // The other methods of the types that are used are declared only.
+        //
+        virtual void SetWholeProgram(decil::IAssembly *program, const std::vector<std::string> &roots) = 0;
+        //
+        // Only compiles the methods of unit. The types of the other
+        // assemblies that the code uses are laid out, but their methods and
+        // static fields are declared only, under the same names as the unit
+        // that defines them, thus the units can be compiled once and linked
+        // together.
+        //
+        virtual void SetCompilationUnit(decil::IAssembly *unit) = 0;
     };
     
     class IIntrinsic
@@ -46,6 +76,7 @@ namespace silk
     };
     
     ICompilationEngine *CreateCompilationEngine(decil::IHost *host, const std::string &triple);
+    ICompilationEngine *CreateCompilationEngine(decil::IHost *host, const std::string &triple, llvm::LLVMContext &context);
     IIntrinsic *CreateAOTIntrinsic(llvm::Module *module);
 }
 
@@ -29,6 +29,11 @@ namespace silk
             virtual IPlatformType *platform_type() = 0;
             
             virtual void AddClassPath(const std::string &path) = 0;
+            // Directory of the .silkmeta files, see lib/decil/MetadataCache.h
+            virtual void SetMetadataCache(const std::string &dir) = 0;
+            // Decode all method bodies on a thread pool when an assembly is
+            // loaded, instead of on first access
+            virtual void SetParallelLoad(bool enabled) = 0;
 
             ErrorHandler &error_handler() { return error_handler_; }
             virtual IAssembly *get_assembly(int idx) = 0;
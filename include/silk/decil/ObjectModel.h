@@ -10,12 +10,19 @@
 #define SILK_DECIL_OBJECT_MODEL_H_
 
 #include "silk/decil/Units.h"
+#include "silk/Support/Atom.h"
+
+#include <llvm/Support/Casting.h>
+
+#include <cassert>
+#include <cstdint>
+#include <vector>
 
 namespace silk
 {
     namespace decil
     {
-        class IOperation;
+        class ILBody;
         class INamedTypeDefinition;
         class AssemblyIdentity;
         class ITypeDefinition;
@@ -23,50 +30,79 @@ namespace silk
         class IGenericTypeParameter;
         class IFieldDefinition;
         class IMethodDefinition;
-        class ITypeMemberDefinition;
         class IAssembly;
 
-        class INamedEntity : virtual public IMetadata
+        //
+        // The interfaces form a tree without virtual bases, thus an
+        // IMetadata can be cast to any of them statically. The kinds that
+        // each classof() accepts are listed in IMetadata::Kind.
+        //
+        class INamedEntity : public IMetadata
         {
         public:
-            virtual const std::u16string &name() = 0;
+            virtual Atom name() = 0;
+            static bool classof(const IMetadata *md)
+            { return md->kind() >= kFieldReference && md->kind() <= kParameterDefinition; }
+        protected:
+            explicit INamedEntity(Kind kind)
+            : IMetadata(kind)
+            {}
         };
         
-        class IModule : virtual public IMetadata
-        {
-        public:
-            ///
-            /// Returns all of the types defined in the current module. These are always named types, in other words:
-            /// INamespaceTypeDefinition or INestedTypeDefinition instances.
-            ///
-            virtual std::vector<INamedTypeDefinition*>::const_iterator all_types_begin() const = 0;
-            virtual std::vector<INamedTypeDefinition*>::const_iterator all_types_end() const = 0;
-            
-        };
-        
-        class IAssemblyReference : virtual public IMetadata
+        class IAssemblyReference : public IMetadata
         {
         public:
             virtual IAssembly *ResolvedAssembly() = 0;
             virtual const AssemblyIdentity &identity() const = 0;
+            static bool classof(const IMetadata *md)
+            { return md->kind() == kAssemblyReference || md->kind() == kAssembly; }
+        protected:
+            explicit IAssemblyReference(Kind kind)
+            : IMetadata(kind)
+            {}
         };
         
-        class IAssembly : public IModule, public IAssemblyReference
+        class IAssembly : public IAssemblyReference
         {
         public:
             virtual IAssembly *ResolvedAssembly() override final
             { return this; }
+            ///
+            /// Returns all of the types defined in the assembly. These are always named types, in other words:
+            /// INamespaceTypeDefinition or INestedTypeDefinition instances.
+            ///
+            virtual std::vector<INamedTypeDefinition*>::const_iterator all_types_begin() const = 0;
+            virtual std::vector<INamedTypeDefinition*>::const_iterator all_types_end() const = 0;
+            // The method that the program starts with, or nullptr for a library
+            virtual IMethodDefinition *entry_point() = 0;
+            // The 16-byte GUID of this build of the module, or nullptr
+            virtual const char *mvid() = 0;
+            virtual IAssemblyReference *get_assembly_reference(size_t idx) = 0;
+            virtual size_t assembly_reference_size() = 0;
+            static bool classof(const IMetadata *md)
+            { return md->kind() == kAssembly; }
+        protected:
+            IAssembly()
+            : IAssemblyReference(kAssembly)
+            {}
         };
         
-        class ITypeReference : virtual public IMetadata
+        class ITypeReference : public IMetadata
         {
         public:
             virtual ITypeDefinition *resolved_type() = 0;
+            static bool classof(const IMetadata *md)
+            { return md->kind() >= kTypeReference && md->kind() <= kVectorType; }
+        protected:
+            explicit ITypeReference(Kind kind)
+            : IMetadata(kind)
+            {}
         };
         
-        class ITypeDefinition : public ITypeReference , public INamedEntity
+        class ITypeDefinition : public ITypeReference
         {
         public:
+            virtual Atom name() = 0;
             virtual ITypeReference *base_class() const = 0;
             virtual IFieldDefinition** field_begin() = 0;
             virtual IFieldDefinition** field_end() = 0;
@@ -78,6 +114,12 @@ namespace silk
             virtual ITypeDefinition *resolved_type() override final
             { return this; }
             
+            static bool classof(const IMetadata *md)
+            { return md->kind() >= kNamespaceType && md->kind() <= kVectorType; }
+        protected:
+            explicit ITypeDefinition(Kind kind)
+            : ITypeReference(kind)
+            {}
         };
         
         class INamedTypeDefinition : public ITypeDefinition
@@ -107,57 +149,92 @@ namespace silk
             virtual TypeCode type_code() const = 0;
             virtual uint32_t packing_size() const = 0;
             virtual uint32_t class_size() const = 0;
-        };
-        
-        class INestedType : virtual public INamedTypeDefinition
-        {
-        public:
+            // The enclosing type when the kind is kNestedType, otherwise nullptr
             virtual ITypeDefinition *owning_type() = 0;
+            
+            static bool classof(const IMetadata *md)
+            { return md->kind() == kNamespaceType || md->kind() == kNestedType; }
+        protected:
+            explicit INamedTypeDefinition(Kind kind)
+            : ITypeDefinition(kind)
+            {}
         };
         
-        class IPointerType : virtual public ITypeDefinition
+        class IPointerType : public ITypeDefinition
         {
         public:
             virtual ITypeReference *target_type() = 0;
+            static bool classof(const IMetadata *md)
+            { return md->kind() == kPointerType; }
+        protected:
+            IPointerType()
+            : ITypeDefinition(kPointerType)
+            {}
         };
         
-        class IVectorType : virtual public ITypeDefinition
+        class IVectorType : public ITypeDefinition
         {
         public:
             virtual ITypeReference *element_type() = 0;
+            static bool classof(const IMetadata *md)
+            { return md->kind() == kVectorType; }
+        protected:
+            IVectorType()
+            : ITypeDefinition(kVectorType)
+            {}
         };
         
         class ITypeMemberReference : public INamedEntity
-        {};
-        
-        class ITypeMemberDefinition : virtual public ITypeMemberReference
         {
         public:
-            virtual INamedTypeDefinition *containing_type() = 0;
-            
+            static bool classof(const IMetadata *md)
+            { return md->kind() >= kFieldReference && md->kind() <= kMethodDefinition; }
+        protected:
+            explicit ITypeMemberReference(Kind kind)
+            : INamedEntity(kind)
+            {}
         };
         
-        class IFieldReference : virtual public ITypeMemberReference
+        class IFieldReference : public ITypeMemberReference
         {
         public:
             virtual IFieldDefinition *resolved_definition() = 0;
+            static bool classof(const IMetadata *md)
+            { return md->kind() == kFieldReference || md->kind() == kFieldDefinition; }
+        protected:
+            explicit IFieldReference(Kind kind)
+            : ITypeMemberReference(kind)
+            {}
         };
         
-        class IMethodReference : virtual public ITypeMemberReference
+        class IMethodReference : public ITypeMemberReference
         {
         public:
             virtual IMethodDefinition *resolved_definition() = 0;
+            static bool classof(const IMetadata *md)
+            { return md->kind() == kMethodReference || md->kind() == kMethodDefinition; }
+        protected:
+            explicit IMethodReference(Kind kind)
+            : ITypeMemberReference(kind)
+            {}
         };
         
-        class IFieldDefinition : public ITypeMemberDefinition, public IFieldReference
+        class IFieldDefinition : public IFieldReference
         {
         public:
             virtual IFieldDefinition *resolved_definition() override final
             { return this; }
+            virtual INamedTypeDefinition *containing_type() = 0;
             virtual raw_istream field_mapping() const = 0;
             virtual ITypeReference *field_type() = 0;
             virtual bool is_static() const = 0;
             virtual bool is_literal() const = 0;
+            static bool classof(const IMetadata *md)
+            { return md->kind() == kFieldDefinition; }
+        protected:
+            IFieldDefinition()
+            : IFieldReference(kFieldDefinition)
+            {}
         };
         
         class ILocalDefinition : public IMetadata
@@ -165,20 +242,33 @@ namespace silk
         public:
             virtual bool is_pinned() const = 0;
             virtual ITypeReference *type() = 0;
+            static bool classof(const IMetadata *md)
+            { return md->kind() == kLocalDefinition; }
+        protected:
+            ILocalDefinition()
+            : IMetadata(kLocalDefinition)
+            {}
         };
         
         class IParameterDefinition : public INamedEntity
         {
         public:
             virtual ITypeReference *type() = 0;
+            static bool classof(const IMetadata *md)
+            { return md->kind() == kParameterDefinition; }
+        protected:
+            IParameterDefinition()
+            : INamedEntity(kParameterDefinition)
+            {}
         };
         
-        class IMethodDefinition : public ITypeMemberDefinition, public IMethodReference
+        class IMethodDefinition : public IMethodReference
         {
         public:
             virtual IMethodDefinition *resolved_definition() override final
             { return this; }
 
+            virtual INamedTypeDefinition *containing_type() = 0;
             virtual bool has_this() const = 0;
             virtual bool explicit_this() const = 0;
             virtual bool is_abstract() const = 0;
@@ -189,23 +279,42 @@ namespace silk
             virtual IParameterDefinition *get_param(int idx) = 0;
             virtual ILocalDefinition **local_begin() = 0;
             virtual ILocalDefinition **local_end() = 0;
-            virtual IOperation **inst_begin() = 0;
-            virtual IOperation **inst_end() = 0;
+            virtual const ILBody &body() = 0;
+            // Drops the decoded body, e.g., once the method has been
+            // compiled. It is decoded again if it is needed afterwards.
+            // The caller must have exclusive access to the method, since
+            // the references returned by body() and the locals are freed.
+            virtual void ReleaseBody() = 0;
+            
+            static bool classof(const IMetadata *md)
+            { return md->kind() == kMethodDefinition; }
+        protected:
+            IMethodDefinition()
+            : IMethodReference(kMethodDefinition)
+            {}
         };
         
         enum Opcode {
-#define CIL_OPCODE(name, code) k##name = code,
-#define CIL_LONG_OPCODE(name, code) k##name = 0xfe << 8 | code,
+#define CIL_OPCODE(name, code, operand, flow) k##name = code,
+#define CIL_LONG_OPCODE(name, code, operand, flow) k##name = 0xfe << 8 | code,
 #include "Opcodes.def"
             kLongOpcodePrefix = 0xFE,
         };
         
+        //
+        // A tagged union of the operand of an instruction. The strings of
+        // ldstr and the targets of switch are kept in the side tables of
+        // the ILBody, the operand only holds their indices.
+        //
         class ILOperand
         {
         public:
-            ILOperand();
+            ILOperand()
+            : type_(kNull)
+            , int64_(0)
+            {}
 
-            enum Type
+            enum Type : uint8_t
             {
                 kNull,
                 kInt,
@@ -217,37 +326,105 @@ namespace silk
             };
             
             Type type() const { return type_; }
-            int64_t GetInt() const;
-            float GetFloat() const;
-            double GetDouble() const;
-            IMetadata *GetMetadata() const;
-            const std::u16string &GetString() const;
-            const std::vector<int> &GetIntArray() const;
+            int64_t GetInt() const
+            { assert (type_ == kInt); return int64_; }
+            float GetFloat() const
+            { assert (type_ == kFloat); return float4_; }
+            double GetDouble() const
+            { assert (type_ == kDouble); return double8_; }
+            IMetadata *GetMetadata() const
+            { assert (type_ == kMetadata); return md_; }
+            // Index into the side table of the ILBody
+            unsigned GetIndex() const
+            { assert (type_ == kString || type_ == kIntArray); return range_.index; }
+            unsigned GetCount() const
+            { assert (type_ == kIntArray); return range_.count; }
             
             void Clear();
             void SetInt(int64_t v);
             void SetFloat(float v);
             void SetDouble(double v);
             void SetMetadata(IMetadata *v);
-            void SetString(const std::u16string &v);
-            void SetIntArray(const std::vector<int> &v);
+            void SetString(unsigned index);
+            void SetIntArray(unsigned index, unsigned count);
         private:
             Type type_;
-            int64_t int64_;
-            float float4_;
-            double double8_;
-            IMetadata *md_;
-            std::u16string str_;
-            std::vector<int> int_arr_;
+            union
+            {
+                int64_t int64_;
+                float float4_;
+                double double8_;
+                IMetadata *md_;
+                struct
+                {
+                    uint32_t index;
+                    uint32_t count;
+                } range_;
+            };
         };
 
-        class IOperation
+        class ILOperation
+        {
+        public:
+            ILOperation(Opcode opcode, int offset, const ILOperand &operand)
+            : opcode_(opcode)
+            , offset_(offset)
+            , operand_(operand)
+            {}
+            Opcode opcode() const { return (Opcode)opcode_; }
+            int offset() const { return offset_; }
+            const ILOperand &operand() const { return operand_; }
+            
+        private:
+            uint16_t opcode_;
+            int32_t offset_;
+            ILOperand operand_;
+        };
+        
+        //
+        // The decoded instructions of a method, stored contiguously in
+        // the order of their offsets.
+        //
+        class ILBody
         {
         public:
-            virtual ~IOperation();
-            virtual Opcode opcode() const = 0;
-            virtual int offset() const = 0;
-            virtual const ILOperand &operand() const = 0;
+            const ILOperation *begin() const
+            { return instructions_.data(); }
+            const ILOperation *end() const
+            { return instructions_.data() + instructions_.size(); }
+            bool empty() const
+            { return instructions_.empty(); }
+            
+            const std::u16string &GetString(const ILOperand &op) const
+            { return strings_[op.GetIndex()]; }
+            // The targets of a switch, op.GetCount() entries
+            const int *GetIntArray(const ILOperand &op) const
+            { return targets_.data() + op.GetIndex(); }
+            
+            // Offsets of the first instructions of the basic blocks, sorted
+            const std::vector<int> &block_starts() const
+            { return block_starts_; }
+            // The parameters that ldarga / starg refer to, which have to
+            // live in memory, in the order of their first use
+            const std::vector<IParameterDefinition*> &memory_params() const
+            { return memory_params_; }
+            
+            void Append(Opcode opcode, int offset, const ILOperand &operand)
+            { instructions_.push_back(ILOperation(opcode, offset, operand)); }
+            void AddBlockStart(int offset)
+            { block_starts_.push_back(offset); }
+            void AddMemoryParam(IParameterDefinition *param);
+            unsigned AddString(const std::u16string &str);
+            unsigned AddIntArray(const std::vector<int> &v);
+            // Also sorts the starts of the basic blocks
+            void Shrink();
+            
+        private:
+            std::vector<ILOperation> instructions_;
+            std::vector<std::u16string> strings_;
+            std::vector<int> targets_;
+            std::vector<int> block_starts_;
+            std::vector<IParameterDefinition*> memory_params_;
         };
         
         
@@ -11,6 +11,7 @@
 
 #include "silk/Support/raw_istream.h"
 
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -20,10 +21,44 @@ namespace silk
     {
         class ITypeReference;
         
+        //
+        // The root of the object model. Every object carries the kind of
+        // its concrete class, thus the interfaces are classified with
+        // llvm::isa<> / llvm::dyn_cast<> in a single compare, see the
+        // classof() of each interface in ObjectModel.h. The kinds of an
+        // interface and of its subclasses form a contiguous range.
+        //
         class IMetadata
         {
         public:
+            enum Kind : uint8_t
+            {
+                kAssemblyReference,
+                kAssembly,
+                kTypeReference,
+                kNamespaceType,
+                kNestedType,
+                kPointerType,
+                kVectorType,
+                kFieldReference,
+                kFieldDefinition,
+                kMethodReference,
+                kMethodDefinition,
+                kParameterDefinition,
+                kLocalDefinition,
+                kPlatformType,
+            };
+            
+            Kind kind() const { return kind_; }
             virtual ~IMetadata();
+            
+        protected:
+            explicit IMetadata(Kind kind)
+            : kind_(kind)
+            {}
+            
+        private:
+            const Kind kind_;
         };
         
         class AssemblyIdentity
@@ -71,6 +106,12 @@ namespace silk
             virtual ITypeReference *system_value_type() = 0;
             virtual ITypeReference *system_array() = 0;
             virtual ITypeReference *system_runtime_field_handle() = 0;
+            static bool classof(const IMetadata *md)
+            { return md->kind() == kPlatformType; }
+        protected:
+            IPlatformType()
+            : IMetadata(kPlatformType)
+            {}
         };
     }
 }
@@ -0,0 +1,74 @@
+//
+//  Arena.cpp
+//  silk
+//
+//  Created by Haohui Mai on 12/23/12.
+//  Copyright (c) 2012 Haohui Mai. All rights reserved.
+//
+
+#include "silk/Support/Arena.h"
+
+#include <cstdint>
+
+namespace silk
+{
+    Arena::Arena(size_t chunk_size)
+    : chunk_size_(chunk_size)
+    , cur_(nullptr)
+    , end_(nullptr)
+    , allocated_(0)
+    {}
+
+    Arena::~Arena()
+    {
+        ResetLocked();
+    }
+
+    void *Arena::Allocate(size_t size, size_t align)
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        auto p = reinterpret_cast<uintptr_t>(cur_);
+        auto aligned = (p + align - 1) & ~(uintptr_t)(align - 1);
+
+        if (!cur_ || aligned + size > reinterpret_cast<uintptr_t>(end_))
+        {
+            // Large objects get a chunk of their own
+            size_t len = size + align > chunk_size_ ? size + align : chunk_size_;
+            char *chunk = static_cast<char*>(::operator new(len));
+            chunks_.push_back(chunk);
+            cur_ = chunk;
+            end_ = chunk + len;
+            p = reinterpret_cast<uintptr_t>(cur_);
+            aligned = (p + align - 1) & ~(uintptr_t)(align - 1);
+        }
+
+        cur_ = reinterpret_cast<char*>(aligned + size);
+        allocated_ += size;
+        return reinterpret_cast<void*>(aligned);
+    }
+
+    void Arena::AddDestructor(void *obj, void (*dtor)(void*))
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        destructors_.push_back(Destructor(obj, dtor));
+    }
+
+    void Arena::Reset()
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        ResetLocked();
+    }
+
+    void Arena::ResetLocked()
+    {
+        for (auto it = destructors_.rbegin(), end = destructors_.rend(); it != end; ++it)
+            it->second(it->first);
+        destructors_.clear();
+
+        for (auto chunk : chunks_)
+            ::operator delete(chunk);
+        chunks_.clear();
+        cur_ = end_ = nullptr;
+        allocated_ = 0;
+    }
+}
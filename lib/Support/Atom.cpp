@@ -0,0 +1,54 @@
+//
+//  Atom.cpp
+//  silk
+//
+//  Created by Haohui Mai on 12/20/12.
+//  Copyright (c) 2012 Haohui Mai. All rights reserved.
+//
+
+#include "silk/Support/Atom.h"
+
+#include <unordered_set>
+#include <mutex>
+
+namespace silk
+{
+    namespace
+    {
+        struct AtomTable
+        {
+            std::mutex lock;
+            std::unordered_set<std::u16string> strings;
+        };
+
+        // Intentionally leaked so that atoms held by static objects stay
+        // valid during the process teardown.
+        AtomTable &GetAtomTable()
+        {
+            static AtomTable *table = new AtomTable();
+            return *table;
+        }
+    }
+
+    Atom::Atom(const std::u16string &s)
+    : str_(nullptr)
+    {
+        if (s.empty())
+            return;
+
+        auto &table = GetAtomTable();
+        std::lock_guard<std::mutex> guard(table.lock);
+        // Elements of an unordered_set never move, so the address is stable.
+        str_ = &*table.strings.insert(s).first;
+    }
+
+    Atom::Atom(const char16_t *s)
+    : Atom(std::u16string(s))
+    {}
+
+    const std::u16string &Atom::str() const
+    {
+        static const std::u16string empty_string;
+        return str_ ? *str_ : empty_string;
+    }
+}
@@ -8,44 +8,99 @@
 
 #include "silk/Support/ErrorHandler.h"
 
-#include <cstdarg>
 #include <cstdio>
 
 namespace silk {
-    ErrorHandler::ErrorHandler()
-    : has_error_(0)
+    ErrorHandler::ErrorHandler(bool quiet)
+    : has_error_(false)
+    , quiet_(quiet)
     {}
     
-    static void PrintMessage(const char *type, const char *fmt, va_list args)
+    void ErrorHandler::Report(const char *type, const char *fmt, va_list args)
     {
-        fprintf(stderr, "\t%s: ", type);
-        vfprintf(stderr, fmt, args);
-        fprintf(stderr, "\n");
+        // Formatted beforehand so that the message is printed at once
+        std::string msg = std::string("\t") + type + ": ";
+        va_list copy;
+        va_copy(copy, args);
+        int n = vsnprintf(nullptr, 0, fmt, copy);
+        va_end(copy);
+        if (n > 0)
+        {
+            auto offset = msg.size();
+            msg.resize(offset + n + 1);
+            vsnprintf(&msg[offset], n + 1, fmt, args);
+            msg.resize(offset + n);
+        }
+        
+        std::lock_guard<std::mutex> guard(lock_);
+        auto it = deferred_scopes_.find(std::this_thread::get_id());
+        if (it != deferred_scopes_.end())
+            it->second->messages_.push_back(std::move(msg));
+        else
+            fprintf(stderr, "%s\n", msg.c_str());
     }
 
     void ErrorHandler::Info(const char *fmt, ...)
     {
+        if (quiet_)
+            return;
         va_list args;
         va_start(args, fmt);
-        PrintMessage("info", fmt, args);
+        Report("info", fmt, args);
         va_end(args);
     }
     
     void ErrorHandler::Warn(const char *fmt, ...)
     {
+        if (quiet_)
+            return;
         va_list args;
         va_start(args, fmt);
-        PrintMessage("warning", fmt, args);
+        Report("warning", fmt, args);
         va_end(args);
     }
     
     void ErrorHandler::Error(const char *fmt, ...)
     {
+        set_error();
+        if (quiet_)
+            return;
         va_list args;
         va_start(args, fmt);
-        PrintMessage("error", fmt, args);
+        Report("error", fmt, args);
         va_end(args);
-        set_error();
+    }
+    
+    void ErrorHandler::FlushDeferred()
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        for (auto &e : deferred_messages_)
+            fprintf(stderr, "%s\n", e.second.c_str());
+        deferred_messages_.clear();
+    }
+    
+    ErrorHandler::DeferredScope::DeferredScope(ErrorHandler &eh, size_t key)
+    : eh_(eh)
+    , key_(key)
+    , outer_(nullptr)
+    {
+        std::lock_guard<std::mutex> guard(eh_.lock_);
+        auto &scope = eh_.deferred_scopes_[std::this_thread::get_id()];
+        outer_ = scope;
+        scope = this;
+    }
+    
+    ErrorHandler::DeferredScope::~DeferredScope()
+    {
+        std::lock_guard<std::mutex> guard(eh_.lock_);
+        auto id = std::this_thread::get_id();
+        if (outer_)
+            eh_.deferred_scopes_[id] = outer_;
+        else
+            eh_.deferred_scopes_.erase(id);
+        
+        // The multimap keeps the messages with the same key in order
+        for (auto &m : messages_)
+            eh_.deferred_messages_.insert(std::make_pair(key_, std::move(m)));
     }
 }
-
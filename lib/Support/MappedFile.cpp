@@ -0,0 +1,141 @@
+//
+//  MappedFile.cpp
+//  silk
+//
+//  Created by Haohui Mai on 12/21/12.
+//  Copyright (c) 2012 Haohui Mai. All rights reserved.
+//
+
+#include "silk/Support/MappedFile.h"
+#include "silk/Support/ErrorHandler.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+
+namespace silk
+{
+    MappedFile::MappedFile(const std::string &path, const char *start, size_t size, time_t mtime)
+    : path_(path)
+    , start_(start)
+    , size_(size)
+    , mtime_(mtime)
+    {}
+
+    MappedFile::~MappedFile()
+    {
+        munmap(const_cast<char*>(start_), size_);
+    }
+
+    MappedFile *MappedFile::Open(const std::string &path, ErrorHandler &eh)
+    {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            eh.Error("Cannot open `%s': %s.", path.c_str(), strerror(errno));
+            return nullptr;
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) < 0 || st.st_size == 0)
+        {
+            eh.Error("Cannot read `%s'.", path.c_str());
+            close(fd);
+            return nullptr;
+        }
+
+        size_t size = st.st_size;
+        void *p = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        // The mapping holds its own reference to the file
+        close(fd);
+
+        if (p == MAP_FAILED)
+        {
+            eh.Error("Cannot map `%s': %s.", path.c_str(), strerror(errno));
+            return nullptr;
+        }
+
+        return new MappedFile(path, static_cast<const char*>(p), size, st.st_mtime);
+    }
+
+    void MappedFile::Advise(const char *begin, size_t length, Advice advice) const
+    {
+        static const int advices[] =
+        {
+            MADV_NORMAL,
+            MADV_SEQUENTIAL,
+            MADV_RANDOM,
+            MADV_WILLNEED,
+        };
+
+        const char *end = begin + length;
+        if (begin < start_)
+            begin = start_;
+        if (end > start_ + size_)
+            end = start_ + size_;
+        if (begin >= end)
+            return;
+
+        static const uintptr_t page_mask = sysconf(_SC_PAGESIZE) - 1;
+        auto b = reinterpret_cast<uintptr_t>(begin) & ~page_mask;
+        auto e = reinterpret_cast<uintptr_t>(end);
+
+        // The advice is only a hint, failures are harmless
+        madvise(reinterpret_cast<void*>(b), e - b, advices[static_cast<int>(advice)]);
+    }
+
+    static bool WriteFile(const std::string &path, const char *data, size_t size)
+    {
+        int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+            return false;
+
+        size_t remaining = size;
+        while (remaining)
+        {
+            ssize_t r = write(fd, data, remaining);
+            if (r < 0 && errno == EINTR)
+                continue;
+            if (r <= 0)
+                break;
+            data += r;
+            remaining -= r;
+        }
+
+        return !close(fd) && !remaining;
+    }
+
+    bool WriteFileAtomically(const std::string &path, const char *data, size_t size)
+    {
+        char suffix[32];
+        snprintf(suffix, sizeof(suffix), ".%d.tmp", static_cast<int>(getpid()));
+        std::string tmp_path = path + suffix;
+        if (!WriteFile(tmp_path, data, size) || rename(tmp_path.c_str(), path.c_str()))
+        {
+            int saved_errno = errno;
+            unlink(tmp_path.c_str());
+            errno = saved_errno;
+            return false;
+        }
+        return true;
+    }
+
+    PageFaultCount PageFaultCount::Current()
+    {
+        PageFaultCount r = { 0, 0 };
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) == 0)
+        {
+            r.minor = usage.ru_minflt;
+            r.major = usage.ru_majflt;
+        }
+        return r;
+    }
+}
@@ -0,0 +1,140 @@
+//
+//  ThreadPool.cpp
+//  silk
+//
+//  Created by Haohui Mai on 12/22/12.
+//  Copyright (c) 2012 Haohui Mai. All rights reserved.
+//
+
+#include "silk/Support/ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+namespace silk
+{
+    namespace
+    {
+        // Shared with the workers, which might start after ParallelFor()
+        // has returned.
+        struct ParallelForState
+        {
+            std::function<void(size_t, size_t)> body;
+            size_t count;
+            size_t grain;
+            size_t chunks;
+            std::atomic<size_t> next_chunk;
+            std::mutex lock;
+            std::condition_variable done_cond;
+            size_t done_chunks;
+
+            void Run()
+            {
+                size_t finished = 0;
+                for (size_t c; (c = next_chunk.fetch_add(1)) < chunks; ++finished)
+                    body(c * grain, std::min(count, (c + 1) * grain));
+
+                if (!finished)
+                    return;
+                std::lock_guard<std::mutex> guard(lock);
+                done_chunks += finished;
+                if (done_chunks == chunks)
+                    done_cond.notify_all();
+            }
+        };
+    }
+
+    ThreadPool::ThreadPool(unsigned threads)
+    : active_(0)
+    , stopping_(false)
+    {
+        if (!threads)
+            threads = std::thread::hardware_concurrency();
+        if (!threads)
+            threads = 1;
+
+        workers_.reserve(threads);
+        for (unsigned i = 0; i < threads; ++i)
+            workers_.push_back(std::thread(&ThreadPool::Run, this));
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock_);
+            stopping_ = true;
+        }
+        queue_cond_.notify_all();
+        for (auto &t : workers_)
+            t.join();
+    }
+
+    void ThreadPool::Async(std::function<void()> task)
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock_);
+            tasks_.push_back(std::move(task));
+        }
+        queue_cond_.notify_one();
+    }
+
+    void ThreadPool::Wait()
+    {
+        std::unique_lock<std::mutex> guard(lock_);
+        idle_cond_.wait(guard, [this] { return tasks_.empty() && !active_; });
+    }
+
+    void ThreadPool::ParallelFor(size_t count, size_t grain,
+                                 const std::function<void(size_t, size_t)> &body)
+    {
+        if (!grain)
+            grain = 1;
+        size_t chunks = (count + grain - 1) / grain;
+        if (chunks <= 1)
+        {
+            if (count)
+                body(0, count);
+            return;
+        }
+
+        auto state = std::make_shared<ParallelForState>();
+        state->body = body;
+        state->count = count;
+        state->grain = grain;
+        state->chunks = chunks;
+        state->next_chunk = 0;
+        state->done_chunks = 0;
+
+        size_t helpers = std::min<size_t>(size(), chunks - 1);
+        for (size_t i = 0; i < helpers; ++i)
+            Async([state]() { state->Run(); });
+
+        state->Run();
+        std::unique_lock<std::mutex> guard(state->lock);
+        state->done_cond.wait(guard, [&state]() { return state->done_chunks == state->chunks; });
+    }
+
+    void ThreadPool::Run()
+    {
+        std::unique_lock<std::mutex> guard(lock_);
+        while (true)
+        {
+            queue_cond_.wait(guard, [this] { return stopping_ || !tasks_.empty(); });
+            if (tasks_.empty())
+                return;
+
+            auto task = std::move(tasks_.front());
+            tasks_.pop_front();
+            ++active_;
+
+            guard.unlock();
+            task();
+            guard.lock();
+
+            --active_;
+            if (tasks_.empty() && !active_)
+                idle_cond_.notify_all();
+        }
+    }
+}
@@ -0,0 +1,29 @@
+//
+//  UTFKernels.h
+//  silk
+//
+//  Created by Haohui Mai on 12/29/12.
+//  Copyright (c) 2012 Haohui Mai. All rights reserved.
+//
+
+#ifndef SILK_LIB_SUPPORT_UTF_KERNELS_H_
+#define SILK_LIB_SUPPORT_UTF_KERNELS_H_
+
+#include <cstddef>
+
+namespace silk
+{
+    //
+    // The ASCII fast paths of the UTF-8 / UTF-16 transcoders. Each kernel
+    // converts the leading ASCII characters of s into out and returns how
+    // many it has converted, i.e., it stops at the first character that
+    // needs the multi-byte decoder.
+    //
+    // The kernels that are compiled with -mavx2 live in a translation unit
+    // of their own, and are only called when the CPU supports them.
+    //
+    size_t WidenASCIIAVX2(const char *s, size_t length, char16_t *out);
+    size_t NarrowASCIIAVX2(const char16_t *s, size_t length, char *out);
+}
+
+#endif
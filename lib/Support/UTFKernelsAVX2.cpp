@@ -0,0 +1,61 @@
+//
+//  UTFKernelsAVX2.cpp
+//  silk
+//
+//  Created by Haohui Mai on 12/29/12.
+//  Copyright (c) 2012 Haohui Mai. All rights reserved.
+//
+
+#include "UTFKernels.h"
+
+#if defined(__AVX2__)
+
+#include <immintrin.h>
+#include <cstdint>
+
+namespace silk
+{
+    size_t WidenASCIIAVX2(const char *s, size_t length, char16_t *out)
+    {
+        size_t i = 0;
+        for (; i + 32 <= length; i += 32)
+        {
+            auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i));
+            if (_mm256_movemask_epi8(v))
+                break;
+
+            auto lo = _mm256_cvtepu8_epi16(_mm256_castsi256_si128(v));
+            auto hi = _mm256_cvtepu8_epi16(_mm256_extracti128_si256(v, 1));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), lo);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i + 16), hi);
+        }
+
+        for (; i < length && static_cast<uint8_t>(s[i]) < 0x80; ++i)
+            out[i] = s[i];
+        return i;
+    }
+
+    size_t NarrowASCIIAVX2(const char16_t *s, size_t length, char *out)
+    {
+        const auto non_ascii = _mm256_set1_epi16(static_cast<short>(0xff80));
+
+        size_t i = 0;
+        for (; i + 32 <= length; i += 32)
+        {
+            auto a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i));
+            auto b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i + 16));
+            if (!_mm256_testz_si256(_mm256_or_si256(a, b), non_ascii))
+                break;
+
+            // The pack works within each 128-bit lane
+            auto packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xd8);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), packed);
+        }
+
+        for (; i < length && s[i] < 0x80; ++i)
+            out[i] = static_cast<char>(s[i]);
+        return i;
+    }
+}
+
+#endif
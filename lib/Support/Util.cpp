@@ -7,43 +7,314 @@
 //
 
 #include "silk/Support/Util.h"
+#include "UTFKernels.h"
 
-#include <locale>
-// #include <codecvt>
+#include <cstdint>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(SILK_HAVE_AVX2)
+#include <cpuid.h>
+#endif
 
-// Ideally it should be done through wstring_convert
-// but gcc does not have the header yet.
 //
-// the following code only works if the characters
-// are in ASCII.
+// Almost all strings in the metadata are ASCII, thus the transcoders
+// convert runs of ASCII characters with the widest SIMD kernel that the
+// CPU supports, and fall back to the scalar decoder for the characters in
+// between. Malformed input is replaced with U+FFFD.
 //
 namespace silk
 {
+    namespace
+    {
+        typedef size_t (*WidenASCIIFunc)(const char *, size_t, char16_t *);
+        typedef size_t (*NarrowASCIIFunc)(const char16_t *, size_t, char *);
+
+        size_t WidenASCIIScalar(const char *s, size_t length, char16_t *out)
+        {
+            size_t i = 0;
+            for (; i < length && static_cast<uint8_t>(s[i]) < 0x80; ++i)
+                out[i] = s[i];
+            return i;
+        }
+
+        size_t NarrowASCIIScalar(const char16_t *s, size_t length, char *out)
+        {
+            size_t i = 0;
+            for (; i < length && s[i] < 0x80; ++i)
+                out[i] = static_cast<char>(s[i]);
+            return i;
+        }
+
+#if defined(__SSE2__)
+        size_t WidenASCIISSE2(const char *s, size_t length, char16_t *out)
+        {
+            const auto zero = _mm_setzero_si128();
+
+            size_t i = 0;
+            for (; i + 16 <= length; i += 16)
+            {
+                auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+                if (_mm_movemask_epi8(v))
+                    break;
+
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_unpacklo_epi8(v, zero));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i + 8), _mm_unpackhi_epi8(v, zero));
+            }
+            return i + WidenASCIIScalar(s + i, length - i, out + i);
+        }
+
+        size_t NarrowASCIISSE2(const char16_t *s, size_t length, char *out)
+        {
+            const auto zero = _mm_setzero_si128();
+            const auto non_ascii = _mm_set1_epi16(static_cast<short>(0xff80));
+
+            size_t i = 0;
+            for (; i + 16 <= length; i += 16)
+            {
+                auto a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+                auto b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i + 8));
+                auto high_bits = _mm_and_si128(_mm_or_si128(a, b), non_ascii);
+                if (_mm_movemask_epi8(_mm_cmpeq_epi16(high_bits, zero)) != 0xffff)
+                    break;
+
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(a, b));
+            }
+            return i + NarrowASCIIScalar(s + i, length - i, out + i);
+        }
+#endif
+
+#if defined(SILK_HAVE_AVX2)
+        bool CPUSupportsAVX2()
+        {
+            unsigned eax, ebx, ecx, edx;
+            if (__get_cpuid_max(0, nullptr) < 7)
+                return false;
+
+            // The OS has to save the YMM registers as well
+            __cpuid(1, eax, ebx, ecx, edx);
+            if (!(ecx & bit_OSXSAVE))
+                return false;
+            unsigned xcr0_lo, xcr0_hi;
+            __asm__ ("xgetbv" : "=a" (xcr0_lo), "=d" (xcr0_hi) : "c" (0));
+            if ((xcr0_lo & 0x6) != 0x6)
+                return false;
+
+            __cpuid_count(7, 0, eax, ebx, ecx, edx);
+            return ebx & bit_AVX2;
+        }
+#endif
+
+        struct ASCIIKernels
+        {
+            WidenASCIIFunc widen;
+            NarrowASCIIFunc narrow;
+        };
+
+        const ASCIIKernels &GetASCIIKernels()
+        {
+            static const ASCIIKernels kernels = []() {
+#if defined(SILK_HAVE_AVX2)
+                if (CPUSupportsAVX2())
+                    return ASCIIKernels { WidenASCIIAVX2, NarrowASCIIAVX2 };
+#endif
+#if defined(__SSE2__)
+                return ASCIIKernels { WidenASCIISSE2, NarrowASCIISSE2 };
+#else
+                return ASCIIKernels { WidenASCIIScalar, NarrowASCIIScalar };
+#endif
+            }();
+            return kernels;
+        }
+
+        // Shorter runs are not worth calling the SIMD kernels for
+        const size_t kShortString = 32;
+        const char16_t kReplacementCharacter = 0xfffd;
+
+        bool IsContinuation(const char *s, size_t length, size_t i, uint8_t lo = 0x80, uint8_t hi = 0xbf)
+        {
+            return i < length && lo <= static_cast<uint8_t>(s[i]) && static_cast<uint8_t>(s[i]) <= hi;
+        }
+
+        //
+        // Decodes the code point at s[*pos] into out and returns the number
+        // of UTF-16 code units that have been written. A malformed sequence
+        // is replaced by U+FFFD as a whole, i.e., up to the first byte that
+        // cannot continue it (Unicode 6.2, 3.9).
+        //
+        size_t DecodeUTF8(const char *s, size_t length, size_t *pos, char16_t *out)
+        {
+            size_t i = *pos;
+            uint8_t b0 = s[i++];
+            uint32_t c = kReplacementCharacter;
+
+            if (0xc2 <= b0 && b0 <= 0xdf)
+            {
+                if (IsContinuation(s, length, i))
+                    c = ((b0 & 0x1f) << 6) | (s[i++] & 0x3f);
+            }
+            else if (0xe0 <= b0 && b0 <= 0xef)
+            {
+                // Neither overlong forms nor surrogates
+                uint8_t lo = b0 == 0xe0 ? 0xa0 : 0x80;
+                uint8_t hi = b0 == 0xed ? 0x9f : 0xbf;
+                if (IsContinuation(s, length, i, lo, hi))
+                {
+                    uint8_t b1 = s[i++];
+                    if (IsContinuation(s, length, i))
+                        c = ((b0 & 0x0f) << 12) | ((b1 & 0x3f) << 6) | (s[i++] & 0x3f);
+                }
+            }
+            else if (0xf0 <= b0 && b0 <= 0xf4)
+            {
+                // Neither overlong forms nor code points above U+10FFFF
+                uint8_t lo = b0 == 0xf0 ? 0x90 : 0x80;
+                uint8_t hi = b0 == 0xf4 ? 0x8f : 0xbf;
+                if (IsContinuation(s, length, i, lo, hi))
+                {
+                    uint8_t b1 = s[i++];
+                    if (IsContinuation(s, length, i))
+                    {
+                        uint8_t b2 = s[i++];
+                        if (IsContinuation(s, length, i))
+                            c = ((b0 & 0x07) << 18) | ((b1 & 0x3f) << 12) | ((b2 & 0x3f) << 6) | (s[i++] & 0x3f);
+                    }
+                }
+            }
+
+            *pos = i;
+            if (c < 0x10000)
+            {
+                out[0] = c;
+                return 1;
+            }
+
+            c -= 0x10000;
+            out[0] = 0xd800 | (c >> 10);
+            out[1] = 0xdc00 | (c & 0x3ff);
+            return 2;
+        }
+
+        // Encodes the code point at s[*pos] into out and returns the number
+        // of bytes that have been written. Unpaired surrogates become U+FFFD.
+        size_t EncodeUTF8(const char16_t *s, size_t length, size_t *pos, char *out)
+        {
+            size_t i = *pos;
+            uint32_t c = s[i++];
+
+            if (0xd800 <= c && c <= 0xdfff)
+            {
+                if (c <= 0xdbff && i < length && 0xdc00 <= s[i] && s[i] <= 0xdfff)
+                    c = 0x10000 + ((c - 0xd800) << 10) + (s[i++] - 0xdc00);
+                else
+                    c = kReplacementCharacter;
+            }
+            *pos = i;
+
+            if (c < 0x80)
+            {
+                out[0] = c;
+                return 1;
+            }
+            if (c < 0x800)
+            {
+                out[0] = 0xc0 | (c >> 6);
+                out[1] = 0x80 | (c & 0x3f);
+                return 2;
+            }
+            if (c < 0x10000)
+            {
+                out[0] = 0xe0 | (c >> 12);
+                out[1] = 0x80 | ((c >> 6) & 0x3f);
+                out[2] = 0x80 | (c & 0x3f);
+                return 3;
+            }
+            out[0] = 0xf0 | (c >> 18);
+            out[1] = 0x80 | ((c >> 12) & 0x3f);
+            out[2] = 0x80 | ((c >> 6) & 0x3f);
+            out[3] = 0x80 | (c & 0x3f);
+            return 4;
+        }
+    }
+
     std::string ToUTF8String(const std::u16string &s)
     {
         auto l = s.length();
+        // Most strings are ASCII and keep this size
         std::string ret(l, '\0');
-        for (size_t i = 0; i < l; ++i)
-            ret[i] = s[i];
-#if 0
-        std::wstring_convert<std::codecvt_utf8_utf16<char16_t>, char16_t> utf16conv;
-        std::string ret = utf16conv.to_bytes(s);
-#endif
+        auto in = s.data();
+
+        // Short names are copied without a branch per character first
+        if (l < kShortString)
+        {
+            char16_t bits = 0;
+            for (size_t i = 0; i < l; ++i)
+            {
+                ret[i] = static_cast<char>(in[i]);
+                bits |= in[i];
+            }
+            if (bits < 0x80)
+                return ret;
+        }
+
+        size_t i = 0, o = 0;
+        while (i < l)
+        {
+            auto n = l - i < kShortString
+                ? NarrowASCIIScalar(in + i, l - i, &ret[o])
+                : GetASCIIKernels().narrow(in + i, l - i, &ret[o]);
+            i += n;
+            o += n;
+            if (i == l)
+                break;
+
+            // A code unit takes at most three bytes, a surrogate pair four
+            if (ret.size() < o + (l - i) * 3)
+                ret.resize(o + (l - i) * 3);
+            while (i < l && in[i] >= 0x80)
+                o += EncodeUTF8(in, l, &i, &ret[o]);
+        }
+        ret.resize(o);
         return ret;
     }
 
     std::u16string ToUTF16String(const std::string &s)
     {
-        auto l = s.length();
+        return ToUTF16String(s.data(), s.length());
+    }
+
+    std::u16string ToUTF16String(const char *s, size_t l)
+    {
+        // No character takes more UTF-16 code units than UTF-8 bytes
         std::u16string ret(l, '\0');
-        for (size_t i = 0; i < l; ++i)
-            ret[i] = s[i];
+        auto out = &ret[0];
 
-#if 0
-        std::wstring_convert<std::codecvt_utf8_utf16<char16_t>, char16_t> utf16conv;
-        std::u16string ret = utf16conv.from_bytes(s);
-#endif
+        if (l < kShortString)
+        {
+            uint8_t bits = 0;
+            for (size_t i = 0; i < l; ++i)
+            {
+                out[i] = static_cast<uint8_t>(s[i]);
+                bits |= s[i];
+            }
+            if (bits < 0x80)
+                return ret;
+        }
+
+        size_t i = 0, o = 0;
+        while (i < l)
+        {
+            auto n = l - i < kShortString
+                ? WidenASCIIScalar(s + i, l - i, out + o)
+                : GetASCIIKernels().widen(s + i, l - i, out + o);
+            i += n;
+            o += n;
+            while (i < l && static_cast<uint8_t>(s[i]) >= 0x80)
+                o += DecodeUTF8(s, l, &i, out + o);
+        }
+        ret.resize(o);
         return ret;
     }
-
 }
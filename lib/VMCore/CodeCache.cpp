@@ -0,0 +1,203 @@
+//
+//  CodeCache.cpp
+//  silk
+//
+//  Created by Haohui Mai on 12/31/12.
+//  Copyright (c) 2012 Haohui Mai. All rights reserved.
+//
+
+#include "CodeCache.h"
+
+#include "silk/Support/ErrorHandler.h"
+#include "silk/Support/MappedFile.h"
+
+#include <llvm/DerivedTypes.h>
+#include <llvm/Function.h>
+#include <llvm/GlobalVariable.h>
+#include <llvm/Instructions.h>
+#include <llvm/Module.h>
+#include <llvm/ADT/OwningPtr.h>
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/Bitcode/ReaderWriter.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+#include <llvm/Transforms/Utils/ValueMapper.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+namespace silk
+{
+    using namespace llvm;
+
+    void StableHash::Add(const void *data, size_t size)
+    {
+        auto p = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < size; ++i)
+        {
+            value_ ^= p[i];
+            value_ *= 0x100000001b3ULL;
+        }
+    }
+
+    void StableHash::Add(Type *ty, bool expand)
+    {
+        if (!ty)
+        {
+            Add(uint64_t(0));
+            return;
+        }
+
+        Add(uint64_t(ty->getTypeID()) + 1);
+        if (auto st = dyn_cast<StructType>(ty))
+        {
+            if (st->hasName())
+            {
+                Add(st->getName().str());
+                if (!expand)
+                    return;
+            }
+
+            Add(uint64_t(st->getNumElements()));
+            for (auto it = st->element_begin(), end = st->element_end(); it != end; ++it)
+                Add(*it, true);
+        }
+        else if (auto pt = dyn_cast<PointerType>(ty))
+        {
+            Add(pt->getElementType(), false);
+        }
+        else if (auto at = dyn_cast<ArrayType>(ty))
+        {
+            Add(uint64_t(at->getNumElements()));
+            Add(at->getElementType(), true);
+        }
+        else if (auto ft = dyn_cast<FunctionType>(ty))
+        {
+            Add(uint64_t(ft->isVarArg()));
+            Add(ft->getReturnType(), true);
+            Add(uint64_t(ft->getNumParams()));
+            for (auto it = ft->param_begin(), end = ft->param_end(); it != end; ++it)
+                Add(*it, true);
+        }
+        else if (auto it = dyn_cast<IntegerType>(ty))
+        {
+            Add(uint64_t(it->getBitWidth()));
+        }
+    }
+
+    CodeCache::CodeCache(const std::string &dir)
+    : dir_(dir)
+    , store_failed_(false)
+    {}
+
+    std::string CodeCache::GetPath(uint64_t key) const
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "/%016llx.bc", static_cast<unsigned long long>(key));
+        return dir_ + name;
+    }
+
+    Module *CodeCache::Load(uint64_t key, const std::string &name, LLVMContext &context)
+    {
+        // A missing entry is not an error
+        ErrorHandler eh(true);
+        OwningPtr<MappedFile> file(MappedFile::Open(GetPath(key), eh));
+        if (!file)
+            return nullptr;
+
+        OwningPtr<MemoryBuffer> buffer(MemoryBuffer::getMemBuffer(StringRef(file->start(), file->size()), "", false));
+        OwningPtr<Module> m(ParseBitcodeFile(buffer.get(), context, nullptr));
+        if (!m)
+            return nullptr;
+
+        auto F = m->getFunction(name);
+        if (!F || F->isDeclaration())
+            return nullptr;
+        return m.take();
+    }
+
+    static void CollectGlobals(Value *v, SmallPtrSet<GlobalValue*, 16> &globals, SmallPtrSet<Constant*, 16> &visited)
+    {
+        if (auto gv = dyn_cast<GlobalValue>(v))
+        {
+            globals.insert(gv);
+        }
+        else if (auto c = dyn_cast<Constant>(v))
+        {
+            if (!visited.insert(c))
+                return;
+            for (auto it = c->op_begin(), end = c->op_end(); it != end; ++it)
+                CollectGlobals(*it, globals, visited);
+        }
+    }
+
+    static GlobalValue *CloneDeclaration(Module *m, GlobalValue *gv)
+    {
+        if (auto F = dyn_cast<Function>(gv))
+            return Function::Create(F->getFunctionType(), GlobalValue::ExternalLinkage, F->getName(), m);
+
+        auto v = cast<GlobalVariable>(gv);
+        auto ty = v->getType()->getElementType();
+        // The string literals are private to each module, thus they are
+        // copied along with the function
+        if (v->hasInternalLinkage() && v->isConstant() && v->hasInitializer())
+            return new GlobalVariable(*m, ty, true, GlobalValue::InternalLinkage, v->getInitializer(), v->getName());
+
+        return new GlobalVariable(*m, ty, v->isConstant(), GlobalValue::ExternalLinkage, nullptr, v->getName());
+    }
+
+    void CodeCache::Store(uint64_t key, Function *F, ErrorHandler &eh)
+    {
+        SmallPtrSet<GlobalValue*, 16> globals;
+        SmallPtrSet<Constant*, 16> visited;
+        for (auto bb = F->begin(), bb_end = F->end(); bb != bb_end; ++bb)
+        {
+            for (auto inst = bb->begin(), inst_end = bb->end(); inst != inst_end; ++inst)
+            {
+                // The handle is the address of a VMField
+                if (inst->getMetadata("silk_runtime_field_handle"))
+                    return;
+
+                for (auto op = inst->op_begin(), op_end = inst->op_end(); op != op_end; ++op)
+                    CollectGlobals(*op, globals, visited);
+            }
+        }
+
+        auto src = F->getParent();
+        Module m(F->getName(), F->getContext());
+        m.setTargetTriple(src->getTargetTriple());
+        m.setDataLayout(src->getDataLayout());
+
+        auto NF = Function::Create(F->getFunctionType(), F->getLinkage(), F->getName(), &m);
+        ValueToValueMapTy vmap;
+        vmap[F] = NF;
+        for (auto gv : globals)
+        {
+            if (gv != F)
+                vmap[gv] = CloneDeclaration(&m, gv);
+        }
+
+        auto dest_arg = NF->arg_begin();
+        for (auto arg = F->arg_begin(), end = F->arg_end(); arg != end; ++arg, ++dest_arg)
+        {
+            dest_arg->setName(arg->getName());
+            vmap[&*arg] = &*dest_arg;
+        }
+
+        SmallVector<ReturnInst*, 8> returns;
+        CloneFunctionInto(NF, F, vmap, true, returns);
+
+        std::string bitcode;
+        {
+            raw_string_ostream os(bitcode);
+            WriteBitcodeToFile(&m, os);
+        }
+
+        auto path = GetPath(key);
+        if (!WriteFileAtomically(path, bitcode.data(), bitcode.size()) && !store_failed_.exchange(true))
+            eh.Warn("Cannot write code cache `%s': %s.", path.c_str(), strerror(errno));
+    }
+}
@@ -0,0 +1,86 @@
+//
+//  CodeCache.h
+//  silk
+//
+//  Created by Haohui Mai on 12/31/12.
+//  Copyright (c) 2012 Haohui Mai. All rights reserved.
+//
+
+#ifndef SILK_LIB_VMCORE_CODE_CACHE_H_
+#define SILK_LIB_VMCORE_CODE_CACHE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace llvm
+{
+    class Function;
+    class LLVMContext;
+    class Module;
+    class Type;
+}
+
+namespace silk
+{
+    class ErrorHandler;
+
+    //
+    // FNV-1a. Unlike std::hash and llvm::hash_combine, the values are the
+    // same in every run, thus they can name files.
+    //
+    class StableHash
+    {
+    public:
+        StableHash()
+        : value_(0xcbf29ce484222325ULL)
+        {}
+        void Add(const void *data, size_t size);
+        void Add(uint64_t v)
+        { Add(&v, sizeof(v)); }
+        void Add(const std::string &s)
+        { Add(s.size()); Add(s.data(), s.size()); }
+        void Add(const std::u16string &s)
+        { Add(s.size()); Add(s.data(), s.size() * sizeof(char16_t)); }
+        // Adds the layout of ty. The structs that are only pointed to are
+        // added by name, since their layouts do not change the code that
+        // handles the pointers.
+        void Add(llvm::Type *ty, bool expand = true);
+        uint64_t value() const
+        { return value_; }
+
+    private:
+        uint64_t value_;
+    };
+
+    //
+    // A directory of the functions that the previous compilations have
+    // generated, one bitcode module per method. An entry is named after
+    // the key of the method, see CompilationEngine::GetMethodKey(), which
+    // covers its IL and the layouts and signatures that the IL refers to.
+    // A method that has changed, or whose dependencies have changed, simply
+    // misses. Nothing is ever evicted.
+    //
+    class CodeCache
+    {
+    public:
+        explicit CodeCache(const std::string &dir);
+        // Reads the entry of key into context. Returns nullptr on a miss,
+        // or if the entry does not define the function that is named name.
+        llvm::Module *Load(uint64_t key, const std::string &name, llvm::LLVMContext &context);
+        // Writes F, along with the declarations of the functions and the
+        // globals that it refers to, to the entry of key. The functions
+        // that refer to the VM model by address are not cached. Several
+        // threads can store entries at the same time.
+        void Store(uint64_t key, llvm::Function *F, ErrorHandler &eh);
+
+    private:
+        std::string GetPath(uint64_t key) const;
+        std::string dir_;
+        // Only the first failure to write an entry is reported
+        std::atomic<bool> store_failed_;
+    };
+}
+
+#endif
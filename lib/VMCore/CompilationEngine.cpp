@@ -7,18 +7,31 @@
 //
 
 #include "CompilationEngine.h"
+#include "CodeCache.h"
+#include "Mangler.h"
+#include "Reachability.h"
 #include "VMClass.h"
 #include "VMMember.h"
 #include "OpcodeCompiler.h"
 
 #include "silk/VMCore/VMModel.h"
 #include "silk/decil/ObjectModel.h"
+#include "silk/Support/ErrorHandler.h"
+#include "silk/Support/ThreadPool.h"
 #include "silk/Support/Util.h"
 
 #include <llvm/LLVMContext.h>
+#include <llvm/Linker.h>
 #include <llvm/Module.h>
+#include <llvm/ADT/OwningPtr.h>
+#include <llvm/Bitcode/ReaderWriter.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Threading.h>
+#include <llvm/Support/raw_ostream.h>
 
+#include <algorithm>
 #include <iostream>
+#include <thread>
 
 namespace silk
 {
@@ -30,13 +43,58 @@ namespace silk
     
     ICompilationEngine *CreateCompilationEngine(IHost *host, const std::string &triple)
     {
-        return new CompilationEngine(host, triple);
+        return new CompilationEngine(host, triple, getGlobalContext());
     }
     
-    CompilationEngine::CompilationEngine(IHost *host, const std::string &triple)
+    ICompilationEngine *CreateCompilationEngine(IHost *host, const std::string &triple, LLVMContext &context)
+    {
+        return new CompilationEngine(host, triple, context);
+    }
+    
+    CompilationEngine::CompilationEngine(IHost *host, const std::string &triple, LLVMContext &context)
+    : CompilationEngine(host, triple, context, false)
+    {}
+    
+    CompilationEngine::~CompilationEngine()
+    {
+        // The context of a shard owns its module
+        for (auto shard : shards_)
+            delete shard;
+        for (auto context : shard_contexts_)
+            delete context;
+        
+        // A class is cached under several keys, e.g., T* of different
+        // references to T
+        std::unordered_set<VMClass*> classes;
+        for (auto &e : vm_types_)
+            classes.insert(e.second);
+        for (auto &e : vm_pointer_type_cache_)
+            classes.insert(e.second);
+        for (auto &e : vm_vector_type_cache_)
+            classes.insert(e.second);
+        for (auto vm_class : classes)
+            delete vm_class;
+        
+        delete intrinsic_;
+        // Shared with the shards
+        if (!is_shard_)
+        {
+            delete code_cache_;
+            delete reachability_;
+        }
+    }
+    
+    CompilationEngine::CompilationEngine(IHost *host, const std::string &triple, LLVMContext &context, bool is_shard)
     : host_(host)
-    , module_(new Module("", getGlobalContext()))
+    , triple_(triple)
+    , module_(new Module("", context))
     , intrinsic_(nullptr)
+    , is_shard_(is_shard)
+    , codegen_shards_(0)
+    , codegen_threads_(0)
+    , code_cache_(nullptr)
+    , reachability_(nullptr)
+    , unit_(nullptr)
     {
         module_->setTargetTriple(triple);
         
@@ -59,20 +117,76 @@ namespace silk
         }
     }
     
+    void CompilationEngine::SetParallelCodegen(unsigned shards, unsigned threads)
+    {
+        codegen_shards_ = shards;
+        codegen_threads_ = threads;
+    }
+    
+    void CompilationEngine::SetCodeCache(const std::string &dir)
+    {
+        code_cache_ = new CodeCache(dir);
+    }
+    
+    void CompilationEngine::SetWholeProgram(IAssembly *program, const std::vector<std::string> &roots)
+    {
+        reachability_ = new ReachabilityAnalysis(host_);
+        if (auto entry_point = program->entry_point())
+            reachability_->AddRoot(entry_point);
+        
+        for (auto &root : roots)
+        {
+            if (!reachability_->AddRoot(root))
+                host_->error_handler().Error("Cannot find the root `%s'.", root.c_str());
+        }
+    }
+    
+    void CompilationEngine::SetCompilationUnit(IAssembly *unit)
+    {
+        unit_ = unit;
+        unit_types_.insert(unit->all_types_begin(), unit->all_types_end());
+    }
+    
+    std::vector<ITypeDefinition*> CompilationEngine::GetCompiledTypes() const
+    {
+        if (reachability_)
+            return reachability_->types();
+        return std::vector<ITypeDefinition*>(unit_->all_types_begin(), unit_->all_types_end());
+    }
+    
     void CompilationEngine::Compile()
     {
-        // The set of loaded assemblies might change during resolution
-        // Thus here it gets the size every time.
-        for (size_t i = 0; i < host_->assembly_size(); ++i)
+        if (reachability_)
+            reachability_->Run();
+        
+        if (codegen_shards_ > 1)
         {
-            auto assembly = host_->get_assembly(i);
-            Layout(assembly);
+            CompileShards();
+            return;
         }
         
-        for (size_t i = 0; i < host_->assembly_size(); ++i)
+        // The types are laid out as the code uses them
+        if (reachability_ || unit_)
         {
-            auto assembly = host_->get_assembly(i);
-            GenerateCode(assembly);
+            auto types = GetCompiledTypes();
+            for (auto type : types)
+                GenerateCode(type);
+        }
+        else
+        {
+            // The set of loaded assemblies might change during resolution
+            // Thus here it gets the size every time.
+            for (size_t i = 0; i < host_->assembly_size(); ++i)
+            {
+                auto assembly = host_->get_assembly(i);
+                GenerateCode(assembly);
+            }
+        }
+        
+        if (code_cache_)
+        {
+            LinkCachedCode();
+            InternalizeStaticFields();
         }
     }
     
@@ -88,16 +202,197 @@ namespace silk
     {
         for (auto it = assembly->all_types_begin(), end = assembly->all_types_end(); it != end; ++it)
         {
-            auto vm_class = GetVMClassForNamedType(*it);
-            for (auto it2 = vm_class->method_begin(), end2 = vm_class->method_end(); it2 != end2; ++it2)
+            GenerateCode(*it);
+        }
+    }
+    
+    void CompilationEngine::GenerateCode(ITypeDefinition *type)
+    {
+        auto vm_class = GetVMClassForNamedType(type);
+        // In the order of the definitions, which is the order in which the
+        // functions are declared
+        for (auto it = type->method_begin(), end = type->method_end(); it != end; ++it)
+        {
+            auto def = *it;
+            if (reachability_ && !reachability_->IsReachable(def))
+                continue;
+            // Only the first of the methods that have the same signature.
+            // The mangled name only needs the signature, thus the body of
+            // a duplicate is never decoded.
+            auto m = vm_class->GetMethod(mangler::mangle(def));
+            if (m->method_def() != def)
+                continue;
+            // Abstract and extern methods, or malformed IL
+            if (def->body().empty())
+                continue;
+            
+            uint64_t key = code_cache_ ? GetMethodKey(m) : 0;
+            Module *cached = nullptr;
+            if (key)
+                cached = code_cache_->Load(key, m->implementation()->getName().str(), module_->getContext());
+            
+            if (cached)
+            {
+                cached_code_.push_back(cached);
+            }
+            else
             {
-                auto m = it2->second;
-                if (m->method_def()->inst_begin() == m->method_def()->inst_end())
-                    continue;
-                
                 OpcodeCompiler compiler(this, m);
                 compiler.Compile();
+                if (key)
+                    code_cache_->Store(key, m->implementation(), host_->error_handler());
+            }
+            // The IR is all that is needed from now on
+            m->method_def()->ReleaseBody();
+        }
+    }
+    
+    //
+    // Every shard is an engine with a context and a module of its own. The
+    // shards lay out the types that their code uses, thus a callee in
+    // another shard is merely a declaration in the module of the caller,
+    // and the types are dealt to the shards in turn. The modules are
+    // linked in the order of the shards, thus the output does not depend
+    // on the number of threads.
+    //
+    void CompilationEngine::CompileShards()
+    {
+        // LLVM guards its global state only after this call
+        llvm_start_multithreaded();
+        
+        for (unsigned i = 0; i < codegen_shards_; ++i)
+        {
+            shard_contexts_.push_back(new LLVMContext());
+            auto shard = new CompilationEngine(host_, triple_, *shard_contexts_.back(), true);
+            shard->set_intrinsic(CreateAOTIntrinsic(shard->module()));
+            shard->code_cache_ = code_cache_;
+            shard->reachability_ = reachability_;
+            shard->unit_ = unit_;
+            shard->unit_types_ = unit_types_;
+            shards_.push_back(shard);
+        }
+        
+        // The calling thread takes shards as well, thus the pool has one
+        // thread less than requested, and none for a single thread.
+        unsigned threads = codegen_threads_ ? codegen_threads_ : std::thread::hardware_concurrency();
+        OwningPtr<ThreadPool> pool(threads > 1 ? new ThreadPool(threads - 1) : nullptr);
+        if (reachability_ || unit_)
+        {
+            // The types are known up front, thus the order in which the
+            // assemblies are loaded does not matter
+            GenerateCodeOnShards(pool.get(), GetCompiledTypes());
+        }
+        else
+        {
+            auto first = shards_.front();
+            size_t done = 0;
+            while (done < host_->assembly_size())
+            {
+                size_t loaded = host_->assembly_size();
+                std::vector<IAssembly*> assemblies;
+                for (size_t i = done; i < loaded; ++i)
+                    assemblies.push_back(host_->get_assembly(i));
+                
+                // The method bodies of the previous round load the assemblies
+                // in whatever order the shards get to them
+                if (done)
+                {
+                    std::stable_sort(assemblies.begin(), assemblies.end(), [](IAssembly *lhs, IAssembly *rhs)
+                                     { return lhs->identity().name() < rhs->identity().name(); });
+                }
+                
+                // The first shard lays out the types alone, thus the assemblies
+                // referred by the layout are loaded in a fixed order.
+                for (size_t i = 0; i < assemblies.size(); ++i)
+                {
+                    first->Layout(assemblies[i]);
+                    for (; loaded < host_->assembly_size(); ++loaded)
+                        assemblies.push_back(host_->get_assembly(loaded));
+                }
+                done = loaded;
+                
+                std::vector<ITypeDefinition*> types;
+                for (auto assembly : assemblies)
+                    types.insert(types.end(), assembly->all_types_begin(), assembly->all_types_end());
+                GenerateCodeOnShards(pool.get(), types);
+            }
+        }
+        
+        if (code_cache_)
+        {
+            auto link = [&](size_t begin, size_t end) {
+                for (size_t s = begin; s < end; ++s)
+                    shards_[s]->LinkCachedCode();
+            };
+            if (pool)
+                pool->ParallelFor(shards_.size(), 1, link);
+            else
+                link(0, shards_.size());
+        }
+        
+        for (auto shard : shards_)
+            LinkShard(shard);
+        InternalizeStaticFields();
+    }
+    
+    void CompilationEngine::GenerateCodeOnShards(ThreadPool *pool, const std::vector<ITypeDefinition*> &types)
+    {
+        auto shard_count = shards_.size();
+        auto generate = [&](size_t begin, size_t end) {
+            for (size_t s = begin; s < end; ++s)
+            {
+                auto shard = shards_[s];
+                for (size_t i = s; i < types.size(); i += shard_count)
+                    shard->GenerateCode(types[i]);
             }
+        };
+        // No pool when the calling thread is the only one
+        if (pool)
+            pool->ParallelFor(shard_count, 1, generate);
+        else
+            generate(0, shard_count);
+    }
+    
+    void CompilationEngine::InternalizeStaticFields()
+    {
+        // Only the static fields are shared between the modules, and there
+        // is a single copy of them now. The ones of a compilation unit are
+        // shared with the units that refer to it as well.
+        auto linkage = unit_ ? GlobalValue::ExternalLinkage : GlobalValue::InternalLinkage;
+        for (auto it = module_->global_begin(), end = module_->global_end(); it != end; ++it)
+        {
+            if (it->getLinkage() == GlobalValue::LinkOnceODRLinkage)
+                it->setLinkage(linkage);
+        }
+    }
+    
+    void CompilationEngine::LinkCachedCode()
+    {
+        for (auto m : cached_code_)
+        {
+            std::string error;
+            if (Linker::LinkModules(module_, m, Linker::DestroySource, &error))
+                host_->error_handler().Error("Failed to link the cached code of `%s': %s", m->getModuleIdentifier().c_str(), error.c_str());
+            delete m;
+        }
+        cached_code_.clear();
+    }
+    
+    void CompilationEngine::LinkShard(CompilationEngine *shard)
+    {
+        // Modules of different contexts can only be linked through bitcode
+        std::string bitcode;
+        {
+            raw_string_ostream os(bitcode);
+            WriteBitcodeToFile(shard->module(), os);
+        }
+        
+        std::string error;
+        OwningPtr<MemoryBuffer> buffer(MemoryBuffer::getMemBuffer(bitcode, "", false));
+        OwningPtr<Module> m(ParseBitcodeFile(buffer.get(), module_->getContext(), &error));
+        if (!m || Linker::LinkModules(module_, m.get(), Linker::DestroySource, &error))
+        {
+            host_->error_handler().Error("Failed to link the code of a shard: %s", error.c_str());
         }
     }
     
@@ -112,7 +407,7 @@ namespace silk
         assert (def);
         VMClass *ret = nullptr;
         
-        if (auto named_type = dynamic_cast<INamedTypeDefinition*>(def))
+        if (auto named_type = dyn_cast<INamedTypeDefinition>(def))
         {
             auto tc = named_type->type_code();
             if (named_type->base_class() &&
@@ -129,7 +424,7 @@ namespace silk
                 ret = VMPrimitiveClass::CreateVMPrimitiveClass(this, named_type);
             }
         }
-        else if (auto pointer_type = dynamic_cast<IPointerType*>(def))
+        else if (auto pointer_type = dyn_cast<IPointerType>(def))
         {
             auto target_type = pointer_type->target_type()->resolved_type();
             assert (target_type);
@@ -146,7 +441,7 @@ namespace silk
                 ret = it->second;
             }
         }
-        else if (auto vector_type = dynamic_cast<IVectorType*>(def))
+        else if (auto vector_type = dyn_cast<IVectorType>(def))
         {
             auto element_type = vector_type->element_type()->resolved_type();
             assert (element_type);
@@ -157,7 +452,7 @@ namespace silk
             {
                 auto vm_element_type = GetVMClassForNamedType(element_type);
                 assert (vm_element_type->normal_type());
-                ret = new VMClassVector(this, vm_element_type);
+                ret = GetVectorType(vm_element_type);
                 vector_type_cache_.insert(std::make_pair(element_type, ret));
             }
             else
@@ -189,6 +484,17 @@ namespace silk
         return result_type;
     }
     
+    VMClass *CompilationEngine::GetVectorType(VMClass *element_type)
+    {
+        auto it = vm_vector_type_cache_.find(element_type);
+        if (it != vm_vector_type_cache_.end())
+            return it->second;
+        
+        auto result_type = new VMClassVector(this, element_type);
+        vm_vector_type_cache_.insert(std::make_pair(element_type, result_type));
+        return result_type;
+    }
+    
     Value *CompilationEngine::GetOrCreateString(const std::u16string &str)
     {
         auto it = string_cache_.find(str);
@@ -220,6 +526,184 @@ namespace silk
         return v;
     }
     
+    //
+    // The key covers everything that the OpcodeCompiler reads: the IL, with
+    // the metadata that it refers to replaced by the layouts and the
+    // signatures that they stand for, and the layouts of the parameters and
+    // the locals. Unlike metadata tokens, these only change when the code
+    // that is generated for the method might change.
+    //
+    // Bump kCodeCacheVersion whenever the generated code changes.
+    //
+    static const uint64_t kCodeCacheVersion = 1;
+    
+    uint64_t CompilationEngine::GetMethodKey(VMMethod *method)
+    {
+        auto def = method->method_def();
+        StableHash h;
+        h.Add(kCodeCacheVersion);
+        h.Add(module_->getTargetTriple());
+        
+        auto f = method->implementation();
+        h.Add(f->getName().str());
+        h.Add(f->getFunctionType());
+        h.Add(GetLayoutKey(GetVMClassForNamedType(def->containing_type())));
+        for (auto it = method->param_begin(), end = method->param_end(); it != end; ++it)
+            h.Add(GetLayoutKey(it->type()));
+        h.Add(GetLayoutKey(method->return_type()));
+        
+        for (auto it = def->local_begin(), end = def->local_end(); it != end; ++it)
+        {
+            auto type = (*it)->type()->resolved_type();
+            if (!type)
+                return 0;
+            h.Add(GetLayoutKey(GetVMClassForNamedType(type)));
+        }
+        
+        auto &body = def->body();
+        for (auto &op : body)
+        {
+            auto &operand = op.operand();
+            h.Add(uint64_t(op.opcode()));
+            h.Add(uint64_t(op.offset()));
+            h.Add(uint64_t(operand.type()));
+            switch (operand.type())
+            {
+                case ILOperand::kNull:
+                    break;
+                case ILOperand::kInt:
+                    h.Add(uint64_t(operand.GetInt()));
+                    break;
+                case ILOperand::kFloat:
+                {
+                    float v = operand.GetFloat();
+                    h.Add(&v, sizeof(v));
+                    break;
+                }
+                case ILOperand::kDouble:
+                {
+                    double v = operand.GetDouble();
+                    h.Add(&v, sizeof(v));
+                    break;
+                }
+                case ILOperand::kIntArray:
+                    h.Add(body.GetIntArray(operand), operand.GetCount() * sizeof(int));
+                    break;
+                case ILOperand::kString:
+                    h.Add(body.GetString(operand));
+                    h.Add(GetLayoutKey(GetVMClassForNamedType(host_->platform_type()->system_string()->resolved_type())));
+                    break;
+                case ILOperand::kMetadata:
+                    if (!AddMetadataKey(&h, def, operand.GetMetadata()))
+                        return 0;
+                    break;
+            }
+        }
+        
+        return h.value() ? h.value() : 1;
+    }
+    
+    bool CompilationEngine::AddMetadataKey(StableHash *h, IMethodDefinition *method, IMetadata *md)
+    {
+        h->Add(uint64_t(md->kind()));
+        if (auto type_ref = dyn_cast<ITypeReference>(md))
+        {
+            auto type = type_ref->resolved_type();
+            if (!type)
+                return false;
+            h->Add(GetLayoutKey(GetVMClassForNamedType(type)));
+        }
+        else if (auto field_ref = dyn_cast<IFieldReference>(md))
+        {
+            auto field_def = field_ref->resolved_definition();
+            if (!field_def)
+                return false;
+            auto vm_class = GetVMClassForNamedType(field_def->containing_type());
+            auto vm_field = vm_class->GetField(field_def->name());
+            if (!vm_field)
+                return false;
+            h->Add(field_def->name().str());
+            h->Add(GetLayoutKey(vm_class));
+            h->Add(GetLayoutKey(vm_field->type()));
+            // The cached code refers to the global of the static fields,
+            // which has to be in the module when the code is linked
+            if (vm_field->is_static())
+                vm_class->static_instance();
+        }
+        else if (auto method_ref = dyn_cast<IMethodReference>(md))
+        {
+            auto method_def = method_ref->resolved_definition();
+            if (!method_def)
+                return false;
+            auto vm_class = GetVMClassForNamedType(method_def->containing_type());
+            auto callee = vm_class->GetMethod(mangler::mangle(method_def));
+            if (!callee)
+                return false;
+            h->Add(callee->implementation()->getName().str());
+            h->Add(callee->implementation()->getFunctionType());
+            h->Add(GetLayoutKey(vm_class));
+            for (auto it = callee->param_begin(), end = callee->param_end(); it != end; ++it)
+                h->Add(GetLayoutKey(it->type()));
+            h->Add(GetLayoutKey(callee->return_type()));
+        }
+        else if (auto param = dyn_cast<IParameterDefinition>(md))
+        {
+            auto begin = method->param_begin(), end = method->param_end();
+            h->Add(uint64_t(std::find(begin, end, param) - begin));
+            auto type = param->type()->resolved_type();
+            if (!type)
+                return false;
+            h->Add(GetLayoutKey(GetVMClassForNamedType(type)));
+        }
+        else if (auto local = dyn_cast<ILocalDefinition>(md))
+        {
+            // The layouts of the locals are part of the key already
+            auto begin = method->local_begin(), end = method->local_end();
+            h->Add(uint64_t(std::find(begin, end, local) - begin));
+        }
+        else
+        {
+            return false;
+        }
+        return true;
+    }
+    
+    uint64_t CompilationEngine::GetLayoutKey(VMClass *vm_class)
+    {
+        if (!vm_class)
+            return 0;
+        
+        auto it = layout_keys_.find(vm_class);
+        if (it != layout_keys_.end())
+            return it->second;
+        
+        StableHash h;
+        h.Add(vm_class->name().str());
+        h.Add(uint64_t(vm_class->IsValueType()));
+        h.Add(vm_class->physical_type());
+        h.Add(vm_class->normal_type(), false);
+        h.Add(vm_class->boxed_type(), false);
+        // The global is only declared by the code that uses it
+        if (auto static_ty = vm_class->static_type())
+            h.Add(static_ty);
+        
+        // Where each field lives in the types above
+        std::vector<VMField*> fields;
+        for (auto it = vm_class->field_begin(), end = vm_class->field_end(); it != end; ++it)
+            fields.push_back(it->second);
+        std::sort(fields.begin(), fields.end(), [](VMField *lhs, VMField *rhs)
+                  { return lhs->is_static() != rhs->is_static() ? lhs->is_static() : lhs->offset() < rhs->offset(); });
+        for (auto f : fields)
+        {
+            h.Add(f->name().str());
+            h.Add(uint64_t(f->is_static()));
+            h.Add(uint64_t(f->offset()));
+        }
+        
+        layout_keys_.insert(std::make_pair(vm_class, h.value()));
+        return h.value();
+    }
+    
     INamedTypeDefinition::TypeCode CompilationEngine::NativeIntTypeCode() const
     {
         return INamedTypeDefinition::TypeCode::Int32;
@@ -13,24 +13,38 @@
 #include "silk/decil/IHost.h"
 #include "silk/decil/ObjectModel.h"
 
+#include <cstdint>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 namespace llvm
 {
     class Value;
     class Module;
+    class LLVMContext;
 }
 
 namespace silk
 {
+    class CodeCache;
+    class ReachabilityAnalysis;
+    class StableHash;
+    class ThreadPool;
     class VMClass;
+    class VMMethod;
     class VMNamedClass;
 
     class CompilationEngine : public ICompilationEngine
     {
     public:
-        CompilationEngine(decil::IHost *host, const std::string &triple);
+        CompilationEngine(decil::IHost *host, const std::string &triple, llvm::LLVMContext &context);
+        ~CompilationEngine();
         virtual void Compile() override final;
+        virtual void SetParallelCodegen(unsigned shards, unsigned threads) override final;
+        virtual void SetCodeCache(const std::string &dir) override final;
+        virtual void SetWholeProgram(decil::IAssembly *program, const std::vector<std::string> &roots) override final;
+        virtual void SetCompilationUnit(decil::IAssembly *unit) override final;
         virtual llvm::Module *module() override final
         { return module_; }
         virtual decil::IHost *host() override final
@@ -39,26 +53,74 @@ namespace silk
         { return intrinsic_; }
         virtual void set_intrinsic(IIntrinsic *intrinsic) override final
         { intrinsic_ = intrinsic; }
+        // Whether code of other modules is linked into the module, i.e.,
+        // the shards of a parallel compilation or the cached methods
+        bool links_modules() const
+        { return is_shard_ || code_cache_; }
+        // Whether the type belongs to another compilation unit, whose
+        // module defines its methods and its static fields
+        bool IsExternal(decil::ITypeDefinition *type) const
+        { return unit_ && !unit_types_.count(type); }
+        bool compiles_unit() const
+        { return unit_; }
         
         VMClass *GetVMClassForNamedType(decil::ITypeDefinition *def);
         VMClass *GetPointerType(VMClass *target_type);
+        VMClass *GetVectorType(VMClass *element_type);
         llvm::Value *GetOrCreateString(const std::u16string &str);
         decil::INamedTypeDefinition::TypeCode NativeIntTypeCode() const;
         decil::INamedTypeDefinition::TypeCode NativeUIntTypeCode() const;
 
     private:
+        CompilationEngine(decil::IHost *host, const std::string &triple, llvm::LLVMContext &context, bool is_shard);
         void Layout(decil::IAssembly *assembly);
         void GenerateCode(decil::IAssembly *assembly);
+        void GenerateCode(decil::ITypeDefinition *type);
+        // The types whose methods are compiled in whole-program or unit mode
+        std::vector<decil::ITypeDefinition*> GetCompiledTypes() const;
+        void CompileShards();
+        void GenerateCodeOnShards(ThreadPool *pool, const std::vector<decil::ITypeDefinition*> &types);
+        void LinkShard(CompilationEngine *shard);
+        void LinkCachedCode();
+        void InternalizeStaticFields();
         
+        // The key of the method in the code cache, or zero if it cannot be cached
+        uint64_t GetMethodKey(VMMethod *method);
+        uint64_t GetLayoutKey(VMClass *vm_class);
+        bool AddMetadataKey(StableHash *h, decil::IMethodDefinition *method, decil::IMetadata *md);
+        
+        // The engine owns the classes, which own their members
         std::unordered_map<decil::ITypeDefinition *, VMClass *> vm_types_;
+        // Keyed by the resolved target, since the host only shares the
+        // structural types whose targets are the same reference, see
+        // Host::GetPointerType().
         std::unordered_map<decil::ITypeDefinition *, VMClass *> pointer_type_cache_;
         std::unordered_map<decil::ITypeDefinition *, VMClass *> vector_type_cache_;
         std::unordered_map<std::u16string, llvm::Value *> string_cache_;
         std::unordered_map<VMClass *, VMClass *> vm_pointer_type_cache_;
+        std::unordered_map<VMClass *, VMClass *> vm_vector_type_cache_;
+        std::unordered_map<VMClass *, uint64_t> layout_keys_;
+        // Linked into the module once all methods have been compiled, since
+        // the linker replaces the declarations that the VMMethods refer to
+        std::vector<llvm::Module *> cached_code_;
 
         decil::IHost *host_;
+        std::string triple_;
         llvm::Module *module_;
         IIntrinsic *intrinsic_;
+        bool is_shard_;
+        unsigned codegen_shards_;
+        unsigned codegen_threads_;
+        // Shared with the shards
+        CodeCache *code_cache_;
+        ReachabilityAnalysis *reachability_;
+        decil::IAssembly *unit_;
+        std::unordered_set<decil::ITypeDefinition *> unit_types_;
+        // The shards outlive the compilation, the linked IR refers to
+        // their VMFields by address. They are deleted with the engine,
+        // before the contexts that own their modules.
+        std::vector<CompilationEngine*> shards_;
+        std::vector<llvm::LLVMContext*> shard_contexts_;
     };
 }
 
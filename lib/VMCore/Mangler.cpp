@@ -15,18 +15,18 @@ namespace silk
     using namespace decil;
     namespace mangler
     {
-        std::u16string mangle(decil::IMethodDefinition *v)
+        Atom mangle(decil::IMethodDefinition *v)
         {
-            std::u16string s = v->name();
+            std::u16string s = v->name().str();
             auto param_start = v->param_begin();
             auto has_implicit_this = v->has_this() && !v->explicit_this();
             if (has_implicit_this)
                 ++param_start;
             for (auto it = param_start, end = v->param_end(); it != end; ++it)
             {
-                s += u"." + (*it)->type()->resolved_type()->name();
+                s += u"." + (*it)->type()->resolved_type()->name().str();
             }
-            return s;
+            return Atom(s);
         }
 
     }
@@ -9,7 +9,7 @@
 #ifndef SILK_LIB_VMCORE_MANGLER_H_
 #define SILK_LIB_VMCORE_MANGLER_H_
 
-#include <string>
+#include "silk/Support/Atom.h"
 
 namespace silk
 {
@@ -20,7 +20,7 @@ namespace silk
     
     namespace mangler
     {
-        std::u16string mangle(decil::IMethodDefinition *v);
+        Atom mangle(decil::IMethodDefinition *v);
     }
 }
 
@@ -208,28 +208,27 @@ namespace silk
         prelude_bb_ = BasicBlock::Create(ctx_, "prelude", current_function_);
         builder_.SetInsertPoint(prelude_bb_);
         DeclareLocalVariables();
-        
-        OpcodeScanner scanner(engine_, prelude_bb_, method_, arguments_, block_info_);
-        scanner.Scan();
+        CopyArgumentsIntoMemory();
+        CreateBasicBlocks();
         
         current_bb_ = prelude_bb_;
 
         
-        for (auto it = method_->method_def()->inst_begin(), end = method_->method_def()->inst_end();
-             it != end; ++it)
+        auto &body = method_->method_def()->body();
+        for (auto it = body.begin(), end = body.end(); it != end; ++it)
         {
-            auto it2 = block_info_.find((*it)->offset());
+            auto it2 = block_info_.find(it->offset());
             if (it2 != block_info_.end())
             {
                 if (!current_bb_->getTerminator())
-                    VisitBr((*it)->offset());
+                    VisitBr(it->offset());
                 
                 current_bb_ = it2->second.bb;
                 builder_.SetInsertPoint(current_bb_);
                 stack_ = it2->second.stack;
             }
 
-            CompileInstruction(*it);
+            CompileInstruction(it);
         }
     }
     
@@ -244,6 +243,41 @@ namespace silk
         }
     }
     
+    //
+    // ldarga / starg need the address of the argument, thus these
+    // arguments are copied into memory in the prelude.
+    //
+    void OpcodeCompiler::CopyArgumentsIntoMemory()
+    {
+        auto method_def = method_->method_def();
+        for (auto param : method_def->body().memory_params())
+        {
+            auto vm_type = engine_->GetVMClassForNamedType(param->type()->resolved_type());
+            auto ptr = builder_.CreateAlloca(vm_type->physical_type());
+            arguments_[param] = ptr;
+            
+            auto AI = current_function_->arg_begin();
+            for (auto it = method_def->param_begin(), end = method_def->param_end(); it != end; ++it, ++AI)
+            {
+                if (*it == param)
+                    break;
+            }
+            builder_.CreateStore(AI, ptr);
+        }
+    }
+    
+    // The decoder has recorded the starts of the basic blocks
+    void OpcodeCompiler::CreateBasicBlocks()
+    {
+        for (auto pos : method_->method_def()->body().block_starts())
+        {
+            BlockInfo info;
+            info.bb = BasicBlock::Create(ctx_, pos ? "" : "entry", current_function_);
+            info.stack = new std::vector<Operand>();
+            block_info_.insert(std::make_pair(pos, info));
+        }
+    }
+    
     void OpcodeCompiler::SwitchBasicBlock(OpcodeCompiler::BlockInfo *bi)
     {
         current_bb_ = bi->bb;
@@ -309,7 +343,7 @@ namespace silk
         }
     }
     
-    void OpcodeCompiler::CompileInstruction(IOperation *op)
+    void OpcodeCompiler::CompileInstruction(const ILOperation *op)
     {
         switch (op->opcode())
         {
@@ -323,7 +357,7 @@ namespace silk
             case kLdarg_3:
             case kLdarg_s:
             case kLdarg:
-                VisitLdarg(dynamic_cast<IParameterDefinition*>(op->operand().GetMetadata()));
+                VisitLdarg(cast<IParameterDefinition>(op->operand().GetMetadata()));
                 break;
 
             case kLdloc_0:
@@ -332,12 +366,12 @@ namespace silk
             case kLdloc_3:
             case kLdloc_s:
             case kLdloc:
-                VisitLdloc(dynamic_cast<ILocalDefinition*>(op->operand().GetMetadata()));
+                VisitLdloc(cast<ILocalDefinition>(op->operand().GetMetadata()));
                 break;
 
             case kLdloca_s:
             case kLdloca:
-                VisitLdloca(dynamic_cast<ILocalDefinition*>(op->operand().GetMetadata()));
+                VisitLdloca(cast<ILocalDefinition>(op->operand().GetMetadata()));
                 break;
 
             case kStloc_0:
@@ -346,18 +380,18 @@ namespace silk
             case kStloc_3:
             case kStloc_s:
             case kStloc:
-                VisitStloc(dynamic_cast<ILocalDefinition*>(op->operand().GetMetadata()));
+                VisitStloc(cast<ILocalDefinition>(op->operand().GetMetadata()));
                 break;
                 
 
             case kLdarga_s:
             case kLdarga:
-                VisitLdarga(dynamic_cast<IParameterDefinition*>(op->operand().GetMetadata()));
+                VisitLdarga(cast<IParameterDefinition>(op->operand().GetMetadata()));
                 break;
                 
             case kStarg_s:
             case kStarg:
-                VisitStarg(dynamic_cast<IParameterDefinition*>(op->operand().GetMetadata()));
+                VisitStarg(cast<IParameterDefinition>(op->operand().GetMetadata()));
                 break;
 
             case kLdnull:
@@ -398,7 +432,7 @@ namespace silk
 //                operand.SetInt(i32);
 //                break;
             case kCall:
-                VisitCall(dynamic_cast<IMethodReference*>(op->operand().GetMetadata()));
+                VisitCall(cast<IMethodReference>(op->operand().GetMetadata()));
                 break;
 //                //                    case kCalli:
 //                //                        value = this.GetFunctionPointerType(memReader.ReadUInt32());
@@ -455,7 +489,7 @@ namespace silk
                 break;
 
             case kSwitch:
-                VisitSwitch(op->operand().GetIntArray(), op->offset());
+                VisitSwitch(method_->method_def()->body().GetIntArray(op->operand()), op->operand().GetCount(), op->offset());
                 break;
             case kLdind_i1:
             case kLdind_u1:
@@ -542,24 +576,24 @@ namespace silk
                 
             // XXX: Implement virtual calls
             case kCallvirt:
-                VisitCall(dynamic_cast<IMethodReference*>(op->operand().GetMetadata()));
+                VisitCall(cast<IMethodReference>(op->operand().GetMetadata()));
                 break;
 //
 //            case kCpobj:
             case kLdobj:
-                VisitLdobj(dynamic_cast<ITypeReference*>(op->operand().GetMetadata()));
+                VisitLdobj(cast<ITypeReference>(op->operand().GetMetadata()));
                 break;
             case kLdstr:
-                VisitLdstr(op->operand().GetString());
+                VisitLdstr(method_->method_def()->body().GetString(op->operand()));
                 break;
             case kNewobj:
-                VisitNewObj(dynamic_cast<IMethodReference*>(op->operand().GetMetadata()));
+                VisitNewObj(cast<IMethodReference>(op->operand().GetMetadata()));
                 break;
             case kCastclass:
-                VisitCastClass(dynamic_cast<ITypeReference*>(op->operand().GetMetadata()));
+                VisitCastClass(cast<ITypeReference>(op->operand().GetMetadata()));
                 break;
             case kIsinst:
-                VisitIsInst(dynamic_cast<ITypeReference*>(op->operand().GetMetadata()));
+                VisitIsInst(cast<ITypeReference>(op->operand().GetMetadata()));
                 break;
 //            case kUnbox:
 //                is >> token;
@@ -569,32 +603,32 @@ namespace silk
 //                break;
             case kLdfld:
             case kLdsfld:
-                VisitLoadField(dynamic_cast<IFieldReference*>(op->operand().GetMetadata()));
+                VisitLoadField(cast<IFieldReference>(op->operand().GetMetadata()));
                 break;
             case kLdflda:
             case kLdsflda:
-                VisitLoadFieldAddress(dynamic_cast<IFieldReference*>(op->operand().GetMetadata()));
+                VisitLoadFieldAddress(cast<IFieldReference>(op->operand().GetMetadata()));
                 break;
             case kStfld:
             case kStsfld:
-                VisitStoreField(dynamic_cast<IFieldReference*>(op->operand().GetMetadata()));
+                VisitStoreField(cast<IFieldReference>(op->operand().GetMetadata()));
                 break;
             case kStobj:
-                VisitStobj(dynamic_cast<ITypeReference*>(op->operand().GetMetadata()));
+                VisitStobj(cast<ITypeReference>(op->operand().GetMetadata()));
                 break;
 
             case kBox:
-                VisitBox(dynamic_cast<ITypeReference*>(op->operand().GetMetadata()));
+                VisitBox(cast<ITypeReference>(op->operand().GetMetadata()));
                 break;
 
             case kNewarr:
-                VisitNewarr(dynamic_cast<ITypeReference*>(op->operand().GetMetadata()));
+                VisitNewarr(cast<ITypeReference>(op->operand().GetMetadata()));
                 break;
             case kLdlen:
                 VisitLdlen();
                 break;
             case kLdelema:
-                VisitLdelema(dynamic_cast<ITypeReference*>(op->operand().GetMetadata()));
+                VisitLdelema(cast<ITypeReference>(op->operand().GetMetadata()));
                 break;
             case kLdelem_i1:
             case kLdelem_u1:
@@ -620,14 +654,14 @@ namespace silk
                 VisitStelem(op->opcode());
                 break;
             case kLdelem:
-                VisitLdelem(dynamic_cast<ITypeReference*>(op->operand().GetMetadata()));
+                VisitLdelem(cast<ITypeReference>(op->operand().GetMetadata()));
                 break;
             case kStelem:
-                VisitStelem(dynamic_cast<ITypeReference*>(op->operand().GetMetadata()));
+                VisitStelem(cast<ITypeReference>(op->operand().GetMetadata()));
                 break;
 
             case kUnbox_any:
-                VisitUnboxAny(dynamic_cast<ITypeReference*>(op->operand().GetMetadata()));
+                VisitUnboxAny(cast<ITypeReference>(op->operand().GetMetadata()));
                 break;
 //            case kRefanyval:
 //                is >> token;
@@ -679,7 +713,7 @@ namespace silk
 //            case kTail_:
 //                break;
             case kInitobj:
-                VisitInitObj(dynamic_cast<ITypeReference*>(op->operand().GetMetadata()));
+                VisitInitObj(cast<ITypeReference>(op->operand().GetMetadata()));
                 break;
 //            case kConstrained_:
 //                is >> token;
@@ -695,7 +729,7 @@ namespace silk
 //            case kRethrow:
 //                break;
             case kSizeof:
-                VisitSizeof(dynamic_cast<ITypeReference*>(op->operand().GetMetadata()));
+                VisitSizeof(cast<ITypeReference>(op->operand().GetMetadata()));
                 break;
 //            case kRefanytype:
 //            case kReadonly_:
@@ -890,13 +924,13 @@ namespace silk
         BranchInst::Create(true_block.bb, false_block.bb, cond, current_bb_);
     }
     
-    void OpcodeCompiler::VisitSwitch(const std::vector<int> &targets, int offset)
+    void OpcodeCompiler::VisitSwitch(const int *targets, unsigned count, int offset)
     {
         Operand value = Pop();
-        int next_off = (int)(offset + 5 + 4 * targets.size());
+        int next_off = (int)(offset + 5 + 4 * count);
         auto next_block = block_info_[next_off].bb;
         auto SI = builder_.CreateSwitch(value.value, next_block);
-        for (unsigned i = 0; i < targets.size(); ++i)
+        for (unsigned i = 0; i < count; ++i)
         {
             auto target = block_info_[targets[i]].bb;
             SI->addCase(builder_.getInt32(i), target);
@@ -1224,7 +1258,7 @@ namespace silk
         DataLayout TD(engine_->module());
         auto intrinsic_new_array = engine_->intrinsic()->new_array();
         auto vm_class = engine_->GetVMClassForNamedType(type_ref->resolved_type());
-        auto vm_array_class = new VMClassVector(engine_, vm_class);
+        auto vm_array_class = engine_->GetVectorType(vm_class);
         vm_array_class->LayoutIfNecessary();
         
         size_t elem_size = TD.getTypeStoreSize(vm_class->normal_type());
@@ -1244,7 +1278,8 @@ namespace silk
         Operand v = Pop();
         auto arr_type_ref = engine_->host()->platform_type()->system_array();
         auto arr_type = engine_->GetVMClassForNamedType(arr_type_ref->resolved_type());
-        auto arr_len_method = arr_type->GetMethod(u"get_Length");
+        static const Atom get_length_name(u"get_Length");
+        auto arr_len_method = arr_type->GetMethod(get_length_name);
         assert (arr_len_method);
         auto arr_ptr = builder_.CreateBitCast(v.value, arr_type->normal_type());
         Push(Operand(arr_ptr, arr_type));
@@ -1364,7 +1399,7 @@ namespace silk
     
     void OpcodeCompiler::VisitLdtoken(IMetadata *md)
     {
-        if (auto field_ref = dynamic_cast<IFieldReference*>(md))
+        if (auto field_ref = dyn_cast_or_null<IFieldReference>(md))
         {
             auto field_def = field_ref->resolved_definition();
             auto parent_class = engine_->GetVMClassForNamedType(field_def->containing_type());
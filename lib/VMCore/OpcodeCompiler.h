@@ -22,7 +22,6 @@ namespace silk
     class CompilationEngine;
     class VMMethod;
     class VMClass;
-    class OpcodeScanner;
     class OpcodeCompiler
     {
     public:
@@ -45,7 +44,9 @@ namespace silk
         
     private:
         void DeclareLocalVariables();
-        void CompileInstruction(decil::IOperation *op);
+        void CopyArgumentsIntoMemory();
+        void CreateBasicBlocks();
+        void CompileInstruction(const decil::ILOperation *op);
         VMClass *GetPrimitiveType(decil::INamedTypeDefinition::TypeCode tc);
         bool IsUnsignedIntVMClass(const VMClass *clazz) const;
         static bool IsConversionToUnsigned(decil::Opcode opcode);
@@ -87,7 +88,7 @@ namespace silk
         void VisitBr(int pos);
         void VisitBrTF(int next_pos, int branch_pos, bool branch_on_true);
         void VisitCompareAndBranch(decil::Opcode opcode, int next_pos, int branch_pos);
-        void VisitSwitch(const std::vector<int> &branches, int op_offset);
+        void VisitSwitch(const int *branches, unsigned count, int op_offset);
         void VisitLeave(int pos);
         void VisitNewObj(decil::IMethodReference *ctor_ref);
         void VisitBinaryOperator(decil::Opcode opcode);
@@ -136,30 +137,6 @@ namespace silk
         llvm::IRBuilder<> builder_;
     };
     
-    //
-    // Scan through the instruction stream to infer the control flow graph
-    // and to figure out which arguments to be copied into memory, in order to
-    // support ldarga / starg.
-    //
-    
-    class OpcodeScanner
-    {
-    public:
-        OpcodeScanner(CompilationEngine *engine, llvm::BasicBlock *prelude, VMMethod *method,
-                      std::unordered_map<decil::IParameterDefinition *, llvm::Value*> &arguments,
-                      std::unordered_map<int, OpcodeCompiler::BlockInfo> &block_info);
-        void Scan();
-        
-    private:
-        void ScanInstruction(decil::IOperation *op, bool *next_inst_as_bb);
-        void CopyArgumentIntoMemory(decil::IParameterDefinition *loc);
-        void RecordStartOfBasicBlock(int pos);
-        CompilationEngine *engine_;
-        llvm::BasicBlock *prelude_;
-        VMMethod *method_;
-        std::unordered_map<decil::IParameterDefinition *, llvm::Value*> &arguments_;
-        std::unordered_map<int, OpcodeCompiler::BlockInfo> &block_info_;
-    };
 }
 #endif
 
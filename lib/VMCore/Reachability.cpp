@@ -0,0 +1,175 @@
+//
+//  Reachability.cpp
+//  silk
+//
+//  Created by Haohui Mai on 12/31/12.
+//  Copyright (c) 2012 Haohui Mai. All rights reserved.
+//
+
+#include "Reachability.h"
+
+#include "silk/decil/Units.h"
+#include "silk/Support/Util.h"
+
+namespace silk
+{
+    using namespace decil;
+    using llvm::dyn_cast;
+
+    ReachabilityAnalysis::ReachabilityAnalysis(IHost *host)
+    : host_(host)
+    , next_(0)
+    {}
+
+    bool ReachabilityAnalysis::AddRoot(const std::string &name)
+    {
+        auto sep = name.find("::");
+        auto type_name = ToUTF16String(name.substr(0, sep));
+        Atom method_name;
+        if (sep != std::string::npos)
+            method_name = Atom(ToUTF16String(name.substr(sep + 2)));
+
+        bool found = false;
+        for (size_t i = 0; i < host_->assembly_size(); ++i)
+        {
+            auto assembly = host_->get_assembly(i);
+            for (auto it = assembly->all_types_begin(), end = assembly->all_types_end(); it != end; ++it)
+            {
+                auto type = *it;
+                if (type->name().str() != type_name)
+                    continue;
+
+                for (auto m = type->method_begin(), m_end = type->method_end(); m != m_end; ++m)
+                {
+                    if (sep == std::string::npos || (*m)->name() == method_name)
+                    {
+                        AddRoot(*m);
+                        found = true;
+                    }
+                }
+            }
+        }
+        return found;
+    }
+
+    void ReachabilityAnalysis::AddRoot(IMethodDefinition *method)
+    {
+        AddMethod(method);
+    }
+
+    void ReachabilityAnalysis::Run()
+    {
+        // The worklist keeps the methods in the order in which they have
+        // been found, thus the order of the types does not depend on the
+        // hash tables.
+        for (; next_ < worklist_.size(); ++next_)
+            VisitMethod(worklist_[next_]);
+    }
+
+    void ReachabilityAnalysis::AddMethod(IMethodDefinition *method)
+    {
+        if (!method || !methods_.insert(method).second)
+            return;
+        worklist_.push_back(method);
+
+        // The constructors of System.String are replaced by its
+        // CreateString methods, see RuntimeHelperFixup.cpp
+        static const Atom ctor_name(u".ctor");
+        static const Atom create_string_name(u"CreateString");
+        auto string_type = host_->platform_type()->system_string()->resolved_type();
+        if (method->name() == ctor_name && method->containing_type() == string_type)
+            AddMethods(string_type, create_string_name);
+    }
+
+    void ReachabilityAnalysis::AddMethods(ITypeDefinition *type, Atom name)
+    {
+        if (!type)
+            return;
+
+        for (auto it = type->method_begin(), end = type->method_end(); it != end; ++it)
+        {
+            if ((*it)->name() == name)
+                AddMethod(*it);
+        }
+    }
+
+    void ReachabilityAnalysis::AddType(ITypeReference *type_ref)
+    {
+        if (!type_ref)
+            return;
+
+        auto type = type_ref->resolved_type();
+        if (!type || !visited_types_.insert(type).second)
+            return;
+
+        if (auto pointer_type = dyn_cast<IPointerType>(type))
+        {
+            AddType(pointer_type->target_type());
+            return;
+        }
+        if (auto vector_type = dyn_cast<IVectorType>(type))
+        {
+            AddType(vector_type->element_type());
+            AddType(host_->platform_type()->system_array());
+            return;
+        }
+
+        types_.push_back(type);
+        AddType(type->base_class());
+
+        // The static constructor runs before the type is first used
+        static const Atom cctor_name(u".cctor");
+        AddMethods(type, cctor_name);
+    }
+
+    void ReachabilityAnalysis::VisitMethod(IMethodDefinition *method)
+    {
+        AddType(method->containing_type());
+        AddType(method->return_type());
+        for (auto it = method->param_begin(), end = method->param_end(); it != end; ++it)
+            AddType((*it)->type());
+
+        auto &body = method->body();
+        if (body.empty())
+            return;
+
+        for (auto it = method->local_begin(), end = method->local_end(); it != end; ++it)
+            AddType((*it)->type());
+
+        auto platform_type = host_->platform_type();
+        for (auto &op : body)
+        {
+            auto &operand = op.operand();
+            if (op.opcode() == kLdlen)
+            {
+                static const Atom get_length_name(u"get_Length");
+                AddMethods(platform_type->system_array()->resolved_type(), get_length_name);
+            }
+            else if (operand.type() == ILOperand::kString)
+            {
+                AddType(platform_type->system_string());
+            }
+            else if (operand.type() == ILOperand::kMetadata)
+            {
+                auto md = operand.GetMetadata();
+                if (auto type_ref = dyn_cast<ITypeReference>(md))
+                {
+                    AddType(type_ref);
+                }
+                else if (auto field_ref = dyn_cast<IFieldReference>(md))
+                {
+                    auto field_def = field_ref->resolved_definition();
+                    if (field_def)
+                    {
+                        AddType(field_def->containing_type());
+                        AddType(field_def->field_type());
+                    }
+                }
+                else if (auto method_ref = dyn_cast<IMethodReference>(md))
+                {
+                    AddMethod(method_ref->resolved_definition());
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,68 @@
+//
+//  Reachability.h
+//  silk
+//
+//  Created by Haohui Mai on 12/31/12.
+//  Copyright (c) 2012 Haohui Mai. All rights reserved.
+//
+
+#ifndef SILK_LIB_VMCORE_REACHABILITY_H_
+#define SILK_LIB_VMCORE_REACHABILITY_H_
+
+#include "silk/decil/IHost.h"
+#include "silk/decil/ObjectModel.h"
+
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace silk
+{
+    //
+    // Finds the methods that the roots call, directly or indirectly, and
+    // the named types that they use, by following the operands of their IL.
+    // The call edges are the ones that the OpcodeCompiler generates, i.e.,
+    // callvirt binds to the method that it refers to.
+    //
+    // Besides the IL, a type that is used brings its base classes and its
+    // static constructor, a vector brings System.Array, and ldlen brings
+    // System.Array.get_Length.
+    //
+    class ReachabilityAnalysis
+    {
+    public:
+        explicit ReachabilityAnalysis(decil::IHost *host);
+        // The name is either the full name of a type, which roots all of its
+        // methods, or Type::Method, which roots the methods of that name.
+        // Returns false if no method matches.
+        bool AddRoot(const std::string &name);
+        void AddRoot(decil::IMethodDefinition *method);
+        // Visits the methods until no new method is found. The bodies stay
+        // decoded for the code generation.
+        void Run();
+
+        bool IsReachable(decil::IMethodDefinition *method) const
+        { return methods_.count(method); }
+        // In the order in which they have been found
+        const std::vector<decil::ITypeDefinition*> &types() const
+        { return types_; }
+        size_t method_size() const
+        { return methods_.size(); }
+
+    private:
+        void AddMethod(decil::IMethodDefinition *method);
+        void AddMethods(decil::ITypeDefinition *type, Atom name);
+        void AddType(decil::ITypeReference *type_ref);
+        void VisitMethod(decil::IMethodDefinition *method);
+
+        decil::IHost *host_;
+        std::unordered_set<decil::IMethodDefinition*> methods_;
+        std::unordered_set<decil::ITypeDefinition*> visited_types_;
+        std::vector<decil::ITypeDefinition*> types_;
+        std::vector<decil::IMethodDefinition*> worklist_;
+        // The methods before it have been visited
+        size_t next_;
+    };
+}
+
+#endif
@@ -9,6 +9,7 @@
 #include "VMClass.h"
 #include "VMMember.h"
 #include "CompilationEngine.h"
+#include "Mangler.h"
 
 #include "silk/Support/Util.h"
 
@@ -32,6 +33,55 @@ namespace silk
         return f->is_static() && !f->is_literal();
     }
     
+    static Atom SystemValueTypeName()
+    {
+        static const Atom name(u"System.ValueType");
+        return name;
+    }
+    
+    static Atom SystemEnumName()
+    {
+        static const Atom name(u"System.Enum");
+        return name;
+    }
+    
+    // The types belong to the context of the engine, since every shard of
+    // a parallel compilation has a context of its own.
+    static Type *GetPrimitiveType(LLVMContext &c, INamedTypeDefinition::TypeCode tc)
+    {
+        typedef INamedTypeDefinition::TypeCode TypeCode;
+        switch (tc)
+        {
+            case TypeCode::Void:
+                return Type::getVoidTy(c);
+            case TypeCode::Boolean:
+                return Type::getInt1Ty(c);
+            case TypeCode::Char:
+                return Type::getInt16Ty(c);
+            case TypeCode::Int8:
+            case TypeCode::UInt8:
+                return Type::getInt8Ty(c);
+            case TypeCode::Int16:
+            case TypeCode::UInt16:
+                return Type::getInt16Ty(c);
+            case TypeCode::Int32:
+            case TypeCode::UInt32:
+                return Type::getInt32Ty(c);
+            case TypeCode::Int64:
+            case TypeCode::UInt64:
+                return Type::getInt64Ty(c);
+            case TypeCode::Single:
+                return Type::getFloatTy(c);
+            case TypeCode::Double:
+                return Type::getDoubleTy(c);
+            case TypeCode::IntPtr:
+            case TypeCode::UIntPtr:
+                return Type::getInt8PtrTy(c);
+            default:
+                return nullptr;
+        }
+    }
+    
     VMClass::VMClass(CompilationEngine *engine)
     : state_(State::kUninitialized)
     , engine_(engine)
@@ -39,10 +89,19 @@ namespace silk
     , normal_type_(nullptr)
     , boxed_type_(nullptr)
     , static_instance_(nullptr)
+    , static_type_(nullptr)
+    , methods_loaded_(false)
+    , static_fields_loaded_(false)
+    , static_type_loaded_(false)
     {}
     
     VMClass::~VMClass()
-    {}
+    {
+        for (auto &e : fields_)
+            delete e.second;
+        for (auto &e : methods_)
+            delete e.second;
+    }
     
     INamedTypeDefinition::TypeCode VMClass::type_code() const
     {
@@ -55,23 +114,64 @@ namespace silk
             Layout();
     }
 
-    VMField *VMClass::GetField(const std::u16string &name) const
+    VMField *VMClass::GetField(Atom name) const
     {
         auto it = fields_.find(name);
         return it == fields_.end() ? nullptr : it->second;
     }
 
-    VMMethod *VMClass::GetMethod(const std::u16string &name) const
+    VMMethod *VMClass::GetMethod(Atom name)
     {
+        LoadMethodsIfNecessary();
         auto it = methods_.find(name);
         return it == methods_.end() ? nullptr : it->second;
     }
     
+    Value *VMClass::static_instance()
+    {
+        if (!static_fields_loaded_)
+        {
+            static_fields_loaded_ = true;
+            LoadStaticFields();
+        }
+        return static_instance_;
+    }
+    
+    StructType *VMClass::static_type()
+    {
+        if (!static_type_loaded_)
+        {
+            static_type_loaded_ = true;
+            static_type_ = CreateStaticType();
+        }
+        return static_type_;
+    }
+    
+    void VMClass::LoadMethodsIfNecessary()
+    {
+        if (!methods_loaded_)
+        {
+            methods_loaded_ = true;
+            LoadVMMethods();
+        }
+    }
+    
+    void VMClass::LoadVMMethods()
+    {}
+    
+    void VMClass::LoadStaticFields()
+    {}
+    
+    StructType *VMClass::CreateStaticType()
+    {
+        return nullptr;
+    }
+    
     VMClassPointer::VMClassPointer(CompilationEngine *engine, VMClass *target_type)
     : VMClass(engine)
     , target_type_(target_type)
     {
-        name_ = target_type->name() + u"*";
+        name_ = Atom(target_type->name().str() + u"*");
 
         auto &c = engine_->module()->getContext();
         is_void_star_type_ = target_type->normal_type() == Type::getVoidTy(c);
@@ -90,7 +190,7 @@ namespace silk
     : VMClass(engine)
     , element_type_(element_type)
     {
-        name_ = element_type_->name() + u"[]";
+        name_ = Atom(element_type_->name().str() + u"[]");
     }
 
     void VMClassVector::Layout()
@@ -105,7 +205,7 @@ namespace silk
         auto &c = engine_->module()->getContext();
         auto ty = StructType::create(c, types);
         
-        ty->setName(ToUTF8String(name_));
+        ty->setName(ToUTF8String(name_.str()));
         
         physical_type_ = ty;
         normal_type_ = PointerType::getUnqual(ty);
@@ -157,70 +257,110 @@ namespace silk
         for (auto it = type_def_->method_begin(), end = type_def_->method_end(); it != end; ++it)
         {
             auto method = *it;
-            auto vm_method = new VMMethod(method);
-
-            auto has_implicit_this = method->has_this() && !method->explicit_this();
-            auto return_ty = engine_->GetVMClassForNamedType(method->return_type()->resolved_type());
-            
-            vm_method->has_implicit_this_ = has_implicit_this;
-            vm_method->return_type_ = return_ty;
-
-            std::vector<Type*> llvm_params;
-            for (auto it2 = method->param_begin(), end2 = method->param_end(); it2 != end2; ++it2)
-            {
-                auto p = *it2;
-                VMClass *vm_type = nullptr;
-                
-                //
-                // Param 0 is the this argument
-                // For valuetype, the this parameter should be a managed pointer
-                //
-                if (has_implicit_this && IsValueType() && it2 == method->param_begin())
-                {
-                    vm_type = engine_->GetPointerType(this);
-                }
-                else
-                {
-                    vm_type = engine_->GetVMClassForNamedType(p->type()->resolved_type());
-                }
-                
-                ParamInfo param_info(p->name(), vm_type, p);
-                vm_method->params_.push_back(param_info);
-                llvm_params.push_back(param_info.type()->normal_type());
-            }
-            
-            auto func_ty = FunctionType::get(vm_method->return_type()->normal_type(), llvm_params, false);
+            auto vm_method = new VMMethod(this, method, mangler::mangle(method));
+            // The first of the methods that have the same signature wins
+            if (!methods_.insert(std::make_pair(vm_method->mangled_name(), vm_method)).second)
+                delete vm_method;
+        }
+    }
+    
+    void VMNamedClassBase::LoadMethodSignature(VMMethod *vm_method)
+    {
+        auto method = vm_method->method_def();
+        auto has_implicit_this = vm_method->has_implicit_this();
+        vm_method->return_type_ = engine_->GetVMClassForNamedType(method->return_type()->resolved_type());
+        
+        std::vector<Type*> llvm_params;
+        for (auto it2 = method->param_begin(), end2 = method->param_end(); it2 != end2; ++it2)
+        {
+            auto p = *it2;
+            VMClass *vm_type = nullptr;
             
-            std::string func_name;
-            if (method->is_pinvoke())
+            //
+            // Param 0 is the this argument
+            // For valuetype, the this parameter should be a managed pointer
+            //
+            if (has_implicit_this && IsValueType() && it2 == method->param_begin())
             {
-                func_name = ToUTF8String(method->name());
+                vm_type = engine_->GetPointerType(this);
             }
             else
             {
-                func_name = ToUTF8String(name() + u"." +u"." + vm_method->mangled_name());
+                vm_type = engine_->GetVMClassForNamedType(p->type()->resolved_type());
             }
             
-            vm_method->implementation_ = Function::Create(func_ty, GlobalValue::ExternalLinkage,
-                                                          func_name, engine_->module());
-
-            methods_.insert(std::make_pair(vm_method->mangled_name(), vm_method));
+            ParamInfo param_info(p->name(), vm_type, p);
+            vm_method->params_.push_back(param_info);
+            llvm_params.push_back(param_info.type()->normal_type());
+        }
+        
+        auto func_ty = FunctionType::get(vm_method->return_type_->normal_type(), llvm_params, false);
+        
+        std::string func_name;
+        if (method->is_pinvoke())
+        {
+            func_name = ToUTF8String(method->name().str());
+        }
+        else
+        {
+            func_name = ToUTF8String(name_.str() + u"." +u"." + vm_method->mangled_name().str());
+        }
+        
+        vm_method->implementation_ = Function::Create(func_ty, GlobalValue::ExternalLinkage,
+                                                      func_name, engine_->module());
+        
+        // RuntimeHelperFixup replaces the constructors of System.String by
+        // its CreateString methods, which need to be declared as well. They
+        // are declared in the order of their definitions, since methods_ is
+        // ordered by the addresses of the Atoms.
+        static const Atom ctor_name(u".ctor");
+        static const Atom create_string_name(u"CreateString");
+        if (type_code() == INamedTypeDefinition::TypeCode::String && vm_method->name() == ctor_name)
+        {
+            for (auto it = type_def_->method_begin(), end = type_def_->method_end(); it != end; ++it)
+            {
+                auto def = *it;
+                if (def->name() != create_string_name)
+                    continue;
+                // Only the first of the methods that have the same signature
+                auto m = GetMethod(mangler::mangle(def));
+                if (m->method_def() == def)
+                    m->implementation();
+            }
         }
     }
     
-    void VMNamedClassBase::LoadStaticFields()
+    StructType *VMNamedClassBase::CreateStaticType()
     {
         auto &c = engine_->module()->getContext();
         auto static_ty = StructType::create(c);
         RefineLLVMType(static_ty, false, IsStaticFieldForClass);
+        return static_ty->getNumElements() ? static_ty : nullptr;
+    }
+    
+    void VMNamedClassBase::LoadStaticFields()
+    {
+        auto static_ty = static_type();
+        if (!static_ty)
+            return;
         
-        if (static_ty->getNumElements())
+        auto name = ToUTF8String(u"static_" + name_.str());
+        if (engine_->IsExternal(type_def_))
         {
-            static_instance_ = new GlobalVariable(*engine_->module(), static_ty, false,
-                                                  GlobalValue::InternalLinkage,
-                                                  Constant::getNullValue(static_ty),
-                                                  ToUTF8String(u"static_" + name_));
+            static_instance_ = new GlobalVariable(*engine_->module(), static_ty, false, GlobalValue::ExternalLinkage,
+                                                  nullptr, name);
+            return;
         }
+        
+        // Every module that is linked defines the static fields that its
+        // methods might use, and the linker keeps one copy of them
+        auto linkage = GlobalValue::InternalLinkage;
+        if (engine_->links_modules())
+            linkage = GlobalValue::LinkOnceODRLinkage;
+        else if (engine_->compiles_unit())
+            linkage = GlobalValue::ExternalLinkage;
+        static_instance_ = new GlobalVariable(*engine_->module(), static_ty, false, linkage,
+                                              Constant::getNullValue(static_ty), name);
     }
     
     void VMNamedClassBase::RefineLLVMType(StructType *type, bool include_base_class, std::function<bool(const VMField*)> filter)
@@ -256,8 +396,8 @@ namespace silk
         bool is_valuetype = base_class;
         if (is_valuetype)
         {
-            auto &name = base_class->resolved_type()->name();
-            is_valuetype = name == u"System.ValueType" || name == u"System.Enum";
+            auto name = base_class->resolved_type()->name();
+            is_valuetype = name == SystemValueTypeName() || name == SystemEnumName();
         }
         return is_valuetype;
     }
@@ -268,8 +408,8 @@ namespace silk
         bool ret = base_class;
         if (base_class)
         {
-            auto &name = base_class->resolved_type()->name();
-            ret = !(name == u"System.ValueType" || name == u"System.Enum");
+            auto name = base_class->resolved_type()->name();
+            ret = !(name == SystemValueTypeName() || name == SystemEnumName());
         }
         return ret;
     }
@@ -283,15 +423,12 @@ namespace silk
         // Create type holders to handle recursive data structures
         auto &c = engine_->module()->getContext();
 
-        physical_type_ = StructType::create(c, ToUTF8String(name_));
+        physical_type_ = StructType::create(c, ToUTF8String(name_.str()));
         normal_type_ = IsValueType() ? physical_type_ : PointerType::getUnqual(physical_type_);
         boxed_type_ = IsValueType() ? physical_type_ : nullptr;
         
         LoadVMFields();
         RefineLLVMType(cast<StructType>(physical_type_), IncludeBaseClass(), IsInstanceFieldForClass);
-        LoadStaticFields();
-        
-        LoadVMMethods();
         state_ = State::kInitialized;
     }
     
@@ -304,7 +441,6 @@ namespace silk
         auto &c = engine_->module()->getContext();
         auto int_ty = Type::getInt32Ty(c);
         physical_type_ = normal_type_ = boxed_type_ = int_ty;
-        LoadVMMethods();
         state_ = State::kInitialized;
     }
     
@@ -316,50 +452,9 @@ namespace silk
     {
         using decil::INamedTypeDefinition;
         
-        struct TypeMap
-        {
-            INamedTypeDefinition::TypeCode tc_;
-            Type *physical_type_;
-            TypeMap(INamedTypeDefinition::TypeCode tc, Type *physical_type)
-            : tc_(tc)
-            , physical_type_(physical_type)
-            {}
-        };
-        
-        static std::vector<TypeMap> maps;
-        
-        if (!maps.size())
-        {
-            auto &c = engine->module()->getContext();
-            // Initialize the type map
-            // Notice that we don't handle the string type here. Defer it until the layout stage.
-            maps.push_back(TypeMap(INamedTypeDefinition::TypeCode::Void, Type::getVoidTy(c)));
-            maps.push_back(TypeMap(INamedTypeDefinition::TypeCode::Boolean, Type::getInt1Ty(c)));
-            maps.push_back(TypeMap(INamedTypeDefinition::TypeCode::Char, Type::getInt16Ty(c)));
-            maps.push_back(TypeMap(INamedTypeDefinition::TypeCode::Int8, Type::getInt8Ty(c)));
-            maps.push_back(TypeMap(INamedTypeDefinition::TypeCode::UInt8, Type::getInt8Ty(c)));
-            maps.push_back(TypeMap(INamedTypeDefinition::TypeCode::Int16, Type::getInt16Ty(c)));
-            maps.push_back(TypeMap(INamedTypeDefinition::TypeCode::UInt16, Type::getInt16Ty(c)));
-            maps.push_back(TypeMap(INamedTypeDefinition::TypeCode::Int32, Type::getInt32Ty(c)));
-            maps.push_back(TypeMap(INamedTypeDefinition::TypeCode::UInt32, Type::getInt32Ty(c)));
-            maps.push_back(TypeMap(INamedTypeDefinition::TypeCode::Int64, Type::getInt64Ty(c)));
-            maps.push_back(TypeMap(INamedTypeDefinition::TypeCode::UInt64, Type::getInt64Ty(c)));
-            maps.push_back(TypeMap(INamedTypeDefinition::TypeCode::Single, Type::getFloatTy(c)));
-            maps.push_back(TypeMap(INamedTypeDefinition::TypeCode::Double, Type::getDoubleTy(c)));
-            maps.push_back(TypeMap(INamedTypeDefinition::TypeCode::IntPtr, Type::getInt8PtrTy(c)));
-            maps.push_back(TypeMap(INamedTypeDefinition::TypeCode::UIntPtr, Type::getInt8PtrTy(c)));
-        }
-        
         auto r = new VMPrimitiveClass(engine, type_def);
-        for (auto & e : maps)
-        {
-            if (e.tc_ == type_def->type_code())
-            {
-                r->physical_type_ = e.physical_type_;
-                r->normal_type_ = e.physical_type_;
-                break;
-            }
-        }
+        // Notice that we don't handle the string type here. Defer it until the layout stage.
+        r->physical_type_ = r->normal_type_ = GetPrimitiveType(engine->module()->getContext(), type_def->type_code());
                 
         assert (type_def->type_code() == INamedTypeDefinition::TypeCode::String || r->normal_type_);
         return r;
@@ -370,7 +465,7 @@ namespace silk
         auto &c = engine_->module()->getContext();
         if (type_def_->type_code() == INamedTypeDefinition::TypeCode::String)
         {
-            physical_type_ = StructType::create(c, ToUTF8String(name_));
+            physical_type_ = StructType::create(c, ToUTF8String(name_.str()));
             normal_type_ = PointerType::getUnqual(physical_type_);
             
             LoadVMFields();
@@ -379,13 +474,10 @@ namespace silk
         else
         {
             LoadVMFields();
-            boxed_type_ = StructType::create(c, ToUTF8String(name_));
+            boxed_type_ = StructType::create(c, ToUTF8String(name_.str()));
             RefineLLVMType(cast<StructType>(boxed_type_), IncludeBaseClass(), IsInstanceFieldForClass);
         }
         
-        LoadStaticFields();
-
-        LoadVMMethods();
         state_ = State::kInitialized;
     }
 }
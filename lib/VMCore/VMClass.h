@@ -10,6 +10,7 @@
 #define SILK_LIB_VMCORE_VMCLASS_H_
 
 #include "silk/decil/ObjectModel.h"
+#include "silk/Support/Atom.h"
 
 #include <llvm/Type.h>
 #include <llvm/DerivedTypes.h>
@@ -42,6 +43,10 @@ namespace silk
     // Second, it invokes the Layout() function to do the real work. That way
     // enables the support of recursive data structure such as linked list.
     //
+    // The layout only covers the fields. The methods, their declarations and
+    // the global of the static fields are created when the code first uses
+    // them.
+    //
     class VMClass
     {
     public:
@@ -65,28 +70,35 @@ namespace silk
 
         virtual bool IsValueType() const = 0;
         
-        const std::u16string &name() const
+        Atom name() const
         { return name_; }
         
-        typedef std::unordered_map<std::u16string, VMField*>::const_iterator field_const_iterator;
-        typedef std::unordered_map<std::u16string, VMMethod*>::const_iterator method_const_iterator;
+        typedef std::unordered_map<Atom, VMField*>::const_iterator field_const_iterator;
+        typedef std::unordered_map<Atom, VMMethod*>::const_iterator method_const_iterator;
         
         field_const_iterator field_begin() const
         { return fields_.begin(); }
         field_const_iterator field_end() const
         { return fields_.end(); }
-        method_const_iterator method_begin() const
-        { return methods_.begin(); }
-        method_const_iterator method_end() const
-        { return methods_.end(); }
+        method_const_iterator method_begin()
+        { LoadMethodsIfNecessary(); return methods_.begin(); }
+        method_const_iterator method_end()
+        { LoadMethodsIfNecessary(); return methods_.end(); }
         
-        VMField *GetField(const std::u16string &name) const;
-        VMMethod *GetMethod(const std::u16string &name) const;
-        llvm::Value *static_instance() const
-        { return static_instance_; }
+        VMField *GetField(Atom name) const;
+        VMMethod *GetMethod(Atom name);
+        // Or nullptr if the class has no static fields
+        llvm::Value *static_instance();
+        // The type of static_instance(), without declaring the global in
+        // the module
+        llvm::StructType *static_type();
         
     protected:
         virtual void Layout() = 0;
+        virtual void LoadVMMethods();
+        virtual void LoadStaticFields();
+        virtual llvm::StructType *CreateStaticType();
+        void LoadMethodsIfNecessary();
 
         State state_;
         CompilationEngine *engine_;
@@ -97,10 +109,14 @@ namespace silk
         
         // Value to store static fields
         llvm::Value *static_instance_;
+        llvm::StructType *static_type_;
+        bool methods_loaded_;
+        bool static_fields_loaded_;
+        bool static_type_loaded_;
         
-        std::u16string name_;
-        std::unordered_map<std::u16string, VMField*> fields_;
-        std::unordered_map<std::u16string, VMMethod*> methods_;
+        Atom name_;
+        std::unordered_map<Atom, VMField*> fields_;
+        std::unordered_map<Atom, VMMethod*> methods_;
     };
     
     class VMNamedClassBase : public VMClass
@@ -108,13 +124,16 @@ namespace silk
     public:
         decil::INamedTypeDefinition *type_def() const
         { return type_def_; }
+        // Called by VMMethod on first use of its signature
+        void LoadMethodSignature(VMMethod *vm_method);
     protected:
         VMNamedClassBase(CompilationEngine *engine, decil::INamedTypeDefinition *type_def);
         virtual decil::INamedTypeDefinition::TypeCode type_code() const;
 
         void LoadVMFields();
-        void LoadVMMethods();
-        void LoadStaticFields();
+        virtual void LoadVMMethods() override;
+        virtual void LoadStaticFields() override;
+        virtual llvm::StructType *CreateStaticType() override;
         
         virtual bool IsValueType() const;
         bool IncludeBaseClass() const;
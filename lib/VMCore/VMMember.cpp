@@ -9,8 +9,6 @@
 #include "VMMember.h"
 #include "VMClass.h"
 
-#include <algorithm>
-
 namespace silk
 {
     using namespace decil;
@@ -18,7 +16,7 @@ namespace silk
     VMMember::~VMMember()
     {}
     
-    VMMember::VMMember(const std::u16string &name)
+    VMMember::VMMember(Atom name)
     : name_(name)
     {}
     
@@ -29,28 +27,23 @@ namespace silk
     , offset_(offset)
     {}
 
-    VMMethod::VMMethod(IMethodDefinition *def)
+    VMMethod::VMMethod(VMNamedClassBase *owner, IMethodDefinition *def, Atom mangled_name)
     : VMMember(def->name())
+    , owner_(owner)
     , implementation_(nullptr)
     , def_(def)
     , return_type_(nullptr)
+    , mangled_name_(mangled_name)
+    , has_implicit_this_(def->has_this() && !def->explicit_this())
     {}
-   
-    const std::u16string &VMMethod::mangled_name()
+    
+    void VMMethod::LoadSignatureIfNecessary()
     {
-        // XXX: Skiping the this argument when mangling the name of the method.
-        // That way the it matches the mangle schemes of IMethodReference.
-        if (mangled_name_.empty())
-        {
-            mangled_name_ = name_;
-            auto it = has_implicit_this() ? ++params_.begin() : params_.begin();
-            std::for_each(it, params_.end(),
-                          [&](const ParamInfo &p) { mangled_name_ += u"." + p.type()->name(); });
-        }
-        return mangled_name_;
+        if (!implementation_)
+            owner_->LoadMethodSignature(this);
     }
     
-    ParamInfo::ParamInfo(const std::u16string &name, VMClass *type, IParameterDefinition *def)
+    ParamInfo::ParamInfo(Atom name, VMClass *type, IParameterDefinition *def)
     : name_(name)
     , def_(def)
     , type_(type)
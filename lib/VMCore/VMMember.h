@@ -10,6 +10,7 @@
 #define SILK_LIB_VMCORE_VMMEMBER_H_
 
 #include "silk/decil/ObjectModel.h"
+#include "silk/Support/Atom.h"
 
 #include <string>
 #include <unordered_map>
@@ -22,16 +23,17 @@ namespace llvm
 namespace silk
 {
     class VMClass;
+    class VMNamedClassBase;
     
     class VMMember
     {
     public:
-        const std::u16string &name() const
+        Atom name() const
         { return name_; }
     protected:
-        VMMember(const std::u16string &name);
+        VMMember(Atom name);
         virtual ~VMMember();
-        std::u16string name_;
+        Atom name_;
     };
     
     class VMField : public VMMember
@@ -58,15 +60,15 @@ namespace silk
     class ParamInfo
     {
     public:
-        const std::u16string &name() const
+        Atom name() const
         { return name_; }
         VMClass *type() const
         { return type_; }
         decil::IParameterDefinition *param_def() const
         { return def_; }
-        ParamInfo(const std::u16string &name, VMClass *type, decil::IParameterDefinition *def);
+        ParamInfo(Atom name, VMClass *type, decil::IParameterDefinition *def);
     private:
-        std::u16string name_;
+        Atom name_;
         decil::IParameterDefinition *def_;
         VMClass *type_;
     };
@@ -76,41 +78,47 @@ namespace silk
     // If the method is an instance method, it includes the `this`
     // parameter as the parameter 0.
     //
+    // The parameters and the declaration of the method are created on first
+    // use, see VMNamedClassBase::LoadMethodSignature().
+    //
     class VMMethod : public VMMember
     {
     public:
         friend class VMNamedClassBase;
-        VMMethod(decil::IMethodDefinition *def);
+        VMMethod(VMNamedClassBase *owner, decil::IMethodDefinition *def, Atom mangled_name);
 
-        llvm::Function *implementation() const
-        { return implementation_; }
+        llvm::Function *implementation()
+        { LoadSignatureIfNecessary(); return implementation_; }
         
-        const std::u16string &mangled_name();
+        Atom mangled_name() const
+        { return mangled_name_; }
         
         VMClass *return_type()
-        { return return_type_; }
+        { LoadSignatureIfNecessary(); return return_type_; }
         
         decil::IMethodDefinition *method_def() const
         { return def_; }
         
-        const ParamInfo &get_param(int idx) const
-        { return params_.at(idx); }
+        const ParamInfo &get_param(int idx)
+        { LoadSignatureIfNecessary(); return params_.at(idx); }
         
-        std::vector<ParamInfo>::const_iterator param_begin() const
-        { return params_.begin(); }
+        std::vector<ParamInfo>::const_iterator param_begin()
+        { LoadSignatureIfNecessary(); return params_.begin(); }
 
-        std::vector<ParamInfo>::const_iterator param_end() const
-        { return params_.end(); }
+        std::vector<ParamInfo>::const_iterator param_end()
+        { LoadSignatureIfNecessary(); return params_.end(); }
         
         bool has_implicit_this() const
         { return has_implicit_this_; }
         
     private:
+        void LoadSignatureIfNecessary();
+        VMNamedClassBase *owner_;
         llvm::Function *implementation_;
         decil::IMethodDefinition *def_;
         std::vector<ParamInfo> params_;
         VMClass *return_type_;
-        std::u16string mangled_name_;
+        Atom mangled_name_;
         bool has_implicit_this_;
     };
 }
@@ -10,6 +10,7 @@
 #include "PEFileToObjectModel.h"
 #include "SignatureConverter.h"
 #include "ILReader.h"
+#include "PEFileReader.h"
 
 #include "silk/decil/IHost.h"
 #include "silk/Support/Util.h"
@@ -28,9 +29,10 @@ namespace silk
         : model_(model)
         {}
         
-        TypeBase::TypeBase(PEFileToObjectModel *model, const TypeDefinition *type_def,
-                           const std::u16string &mangled_name)
-        : DefinitionBase(model)
+        TypeBase::TypeBase(Kind kind, PEFileToObjectModel *model, const TypeDefinition *type_def,
+                           Atom mangled_name)
+        : INamedTypeDefinition(kind)
+        , DefinitionBase(model)
         , type_def_(type_def)
         , mangled_name_(mangled_name)
         , base_class_(nullptr)
@@ -42,11 +44,14 @@ namespace silk
         
         ITypeReference *TypeBase::base_class() const
         {
-            if (base_class_)
-                return base_class_;
+            // Racing threads resolve the same reference
+            auto ret = base_class_.load(std::memory_order_acquire);
+            if (ret)
+                return ret;
             
-            base_class_ = model_->GetTypeReferenceForToken(&type_def_->Extends);
-            return base_class_;
+            ret = model_->GetTypeReferenceForToken(&type_def_->Extends);
+            base_class_.store(ret, std::memory_order_release);
+            return ret;
         }
         
         Assembly::Assembly(PEFileToObjectModel *model, const AssemblyIdentity &id)
@@ -64,19 +69,47 @@ namespace silk
             return model_->named_typedefs().end();
         }
         
+        IMethodDefinition *Assembly::entry_point()
+        {
+            return model_->GetEntryPoint();
+        }
+        
+        const char *Assembly::mvid()
+        {
+            return model_->file()->GetMvid();
+        }
+        
+        IAssemblyReference *Assembly::get_assembly_reference(size_t idx)
+        {
+            return model_->GetAssemblyReference(idx);
+        }
+        
+        size_t Assembly::assembly_reference_size()
+        {
+            return model_->assembly_reference_size();
+        }
+        
         AssemblyReference::AssemblyReference(IHost *host, const AssemblyIdentity &id)
-        : host_(host)
+        : IAssemblyReference(kAssemblyReference)
+        , host_(host)
         , id_(id)
+        , resolved_assembly_(nullptr)
         {
         }
         
         IAssembly *AssemblyReference::ResolvedAssembly()
         {
-            return host_->LoadAssembly(id_);
+            auto ret = resolved_assembly_.load(std::memory_order_acquire);
+            if (ret)
+                return ret;
+            
+            ret = host_->LoadAssembly(id_);
+            resolved_assembly_.store(ret, std::memory_order_release);
+            return ret;
         }
         
         NonGenericNamespaceType::NonGenericNamespaceType(PEFileToObjectModel *model, const TypeDefinition *e)
-        : TypeBase(model, e, (std::u16string)e->TypeNamespace + u"." + (std::u16string)e->TypeName)
+        : TypeBase(kNamespaceType, model, e, Atom(model->file()->GetString(e->TypeNamespace) + u"." + model->file()->GetString(e->TypeName)))
         {}
         
         NonGenericNamespaceTypeWithPrimitiveType::NonGenericNamespaceTypeWithPrimitiveType(PEFileToObjectModel *model, const TypeDefinition *e, INamedTypeDefinition::TypeCode type_code)
@@ -87,33 +120,36 @@ namespace silk
         NonGenericNestedType::NonGenericNestedType(PEFileToObjectModel *model,
                                                    const TypeDefinition *e,
                                                    unsigned owning_type_idx)
-        : TypeBase(model, e, u"")
+        : TypeBase(kNestedType, model, e, Atom())
         , owning_type_(nullptr)
         , owning_type_idx_(owning_type_idx)
         {}
         
         ITypeDefinition *NonGenericNestedType::owning_type()
         {
-            if (owning_type_)
-                return owning_type_;
+            auto ret = owning_type_.load(std::memory_order_acquire);
+            if (ret)
+                return ret;
             
-            owning_type_ = model_->GetTypeDefinitionAtRow(owning_type_idx_);
-            return owning_type_;
+            ret = model_->GetTypeDefinitionAtRow(owning_type_idx_);
+            owning_type_.store(ret, std::memory_order_release);
+            return ret;
         }
 
-        const std::u16string &NonGenericNestedType::name()
+        Atom NonGenericNestedType::name()
         {
-            if (!mangled_name_.empty())
-                return mangled_name_;
-            
-            mangled_name_ = owning_type()->name()
-            + u"."
-            + (std::u16string)type_def_->TypeNamespace + u"." + (std::u16string)type_def_->TypeName;
+            std::call_once(name_built_, [this]() {
+                auto file = model_->file();
+                mangled_name_ = Atom(owning_type()->name().str()
+                                     + u"."
+                                     + file->GetString(type_def_->TypeNamespace) + u"." + file->GetString(type_def_->TypeName));
+            });
             return mangled_name_;
         }
         
         TypeReference::TypeReference(IAssemblyReference *assembly_ref, const std::u16string &name, const std::u16string &namespace_name)
-        : type_(Scope::kAssemblyRef)
+        : ITypeReference(kTypeReference)
+        , type_(Scope::kAssemblyRef)
         , resolved_type_(nullptr)
         , assembly_ref_(assembly_ref)
         , name_(name)
@@ -122,10 +158,10 @@ namespace silk
         
         ITypeDefinition *TypeReference::resolved_type()
         {
-            if (resolved_type_)
-                return resolved_type_;
+            auto ret = resolved_type_.load(std::memory_order_acquire);
+            if (ret)
+                return ret;
             
-            ITypeDefinition *ret = nullptr;
             
             if (type_ == kAssemblyRef)
             {
@@ -139,7 +175,7 @@ namespace silk
             {
                 assert (0 && "Unimplemented");
             }
-            resolved_type_ = ret;
+            resolved_type_.store(ret, std::memory_order_release);
             return ret;
         }
         
@@ -147,11 +183,11 @@ namespace silk
         : target_type_(target_type)
         {}
         
-        const std::u16string &PointerType::name()
+        Atom PointerType::name()
         {
-            if (name_.empty())
-                name_ = target_type_->resolved_type()->name() + u"*";
-            
+            std::call_once(name_built_, [this]() {
+                name_ = Atom(target_type_->resolved_type()->name().str() + u"*");
+            });
             return name_;
         }
         
@@ -159,27 +195,29 @@ namespace silk
         : element_type_(element_type)
         {}
         
-        const std::u16string &VectorType::name()
+        Atom VectorType::name()
         {
-            if (name_.empty())
-                name_ = element_type_->resolved_type()->name() + u"[]";
-            
+            std::call_once(name_built_, [this]() {
+                name_ = Atom(element_type_->resolved_type()->name().str() + u"[]");
+            });
             return name_;
         }
         
         FieldReference::FieldReference(PEFileToObjectModel *model, const MemberReference *member_ref,
                                        ITypeReference *parent_ref)
-        : model_(model)
-        , name_((std::u16string)member_ref->Name)
+        : IFieldReference(kFieldReference)
+        , model_(model)
+        , name_(model->file()->GetAtom(member_ref->Name))
         , parent_ref_(parent_ref)
         , resolved_def_(nullptr)
-        , signauture_(member_ref->Signature.to_istream())
+        , signauture_(model->file()->GetBlob(member_ref->Signature))
         {}
 
         IFieldDefinition *FieldReference::resolved_definition()
         {
-            if (resolved_def_)
-                return resolved_def_;
+            auto ret = resolved_def_.load(std::memory_order_acquire);
+            if (ret)
+                return ret;
             
             auto type = parent_ref_->resolved_type();
             for (auto it = type->field_begin(), end = type->field_end(); it != end; ++it)
@@ -187,32 +225,35 @@ namespace silk
                 auto f = *it;
                 if (f->name() == name_)
                 {
-                    resolved_def_ = f;
+                    ret = f;
+                    resolved_def_.store(ret, std::memory_order_release);
                     break;
                 }
             }
             
-            return resolved_def_;
+            return ret;
         }
 
         MethodReference::MethodReference(PEFileToObjectModel *model, const MemberReference *member_ref,
                                        ITypeReference *parent_ref)
-        : model_(model)
-        , name_((std::u16string)member_ref->Name)
+        : IMethodReference(kMethodReference)
+        , model_(model)
+        , name_(model->file()->GetAtom(member_ref->Name))
         , parent_ref_(parent_ref)
         , resolved_def_(nullptr)
-        , signauture_(member_ref->Signature.to_istream())
+        , signauture_(model->file()->GetBlob(member_ref->Signature))
         {}
         
         IMethodDefinition *MethodReference::resolved_definition()
         {
-            if (resolved_def_)
-                return resolved_def_;
+            auto ret = resolved_def_.load(std::memory_order_acquire);
+            if (ret)
+                return ret;
             
             auto type = parent_ref_->resolved_type();
-            MethodSignatureConverter converter(model_, signauture_);
-            auto params_name = PEFileToObjectModel::MangleParams(converter.param_type());
-            auto has_implicit_this = converter.has_this() && !converter.explicit_this();
+            auto converter = model_->GetMethodSignature(signauture_);
+            auto params_name = PEFileToObjectModel::MangleParams(converter->param_type());
+            auto has_implicit_this = converter->has_this() && !converter->explicit_this();
             
             for (auto it = type->method_begin(), end = type->method_end(); it != end; ++it)
             {
@@ -233,28 +274,29 @@ namespace silk
                 auto method_signature_name = PEFileToObjectModel::MangleParams(param_type);
                 if (params_name == method_signature_name)
                 {
-                    resolved_def_ = m;
+                    ret = m;
+                    resolved_def_.store(ret, std::memory_order_release);
                     break;
                 }
             }
-            return resolved_def_;
+            return ret;
         }
 
         
         FieldDefinition::FieldDefinition(PEFileToObjectModel *model, const FieldDef *def,
                                          INamedTypeDefinition *containing_type)
         : DefinitionBase(model)
-        , name_(def->Name.string)
+        , name_(model->file()->GetAtom(def->Name))
         , containing_type_(containing_type)
         , flags_(def->Flags)
         , type_(nullptr)
-        , signauture_(def->Signature.to_istream())
+        , signauture_(model->file()->GetBlob(def->Signature))
         {
             if (has_field_rva())
                 mapping_ = model->GetFieldMapping(def);
         }
         
-        const std::u16string &FieldDefinition::name()
+        Atom FieldDefinition::name()
         {
             return name_;
         }
@@ -276,12 +318,13 @@ namespace silk
         
         ITypeReference *FieldDefinition::field_type()
         {
-            if (type_)
-                return type_;
+            auto ret = type_.load(std::memory_order_acquire);
+            if (ret)
+                return ret;
             
-            FieldSignatureConverter converter(model_, signauture_);
-            type_ = converter.resolved_type();
-            return type_;
+            ret = model_->GetFieldType(signauture_);
+            type_.store(ret, std::memory_order_release);
+            return ret;
         }
         
         LocalDefinition::LocalDefinition(bool is_pinned, ITypeReference *type)
@@ -292,17 +335,21 @@ namespace silk
         MethodDefinition::MethodDefinition(PEFileToObjectModel *model, const MethodDef *def,
                                            INamedTypeDefinition *containing_type)
         : DefinitionBase(model)
-        , name_(def->Name)
+        , name_(model->file()->GetAtom(def->Name))
+        , signature_flags_(0)
         , flags_(def->Flags)
         , method_def_(def)
         , containing_type_(containing_type)
+        , return_type_(nullptr)
+        , method_il_(nullptr)
+        , body_loaded_(false)
         {}
         
         bool MethodDefinition::has_this() const
-        { return signature_flags_ & SignatureConverter::kHasThis; }
+        { LoadSignature(); return signature_flags_ & SignatureConverter::kHasThis; }
         
         bool MethodDefinition::explicit_this() const
-        { return signature_flags_ & SignatureConverter::kExplicitThis; }
+        { LoadSignature(); return signature_flags_ & SignatureConverter::kExplicitThis; }
         
         bool MethodDefinition::is_abstract() const
         { return flags_ & MethodDef::kAbstract; }
@@ -310,27 +357,54 @@ namespace silk
         { return flags_ & MethodDef::kPInvokeImplementation; }
 
         
-        void MethodDefinition::LoadInstructions()
+        void MethodDefinition::LoadSignature() const
+        {
+            auto self = const_cast<MethodDefinition*>(this);
+            std::call_once(signature_loaded_, [self]() {
+                self->model_->LoadMethodSignature(self);
+            });
+        }
+        
+        void MethodDefinition::LoadBody() const
         {
+            // The IL refers to the parameters
+            LoadSignature();
+            if (body_loaded_.load(std::memory_order_acquire))
+                return;
+            
+            std::lock_guard<std::mutex> guard(body_lock_);
+            if (body_loaded_.load(std::memory_order_relaxed))
+                return;
+            
+            auto self = const_cast<MethodDefinition*>(this);
+            model_->LoadMethodBody(self);
             if (method_il_)
             {
-                ILReader il_reader(model_, this);
-                il_reader.ReadIL();
-                instructions_.swap(il_reader.GetInstructions());
+                // Malformed IL leaves the body empty, which is not compiled
+                ILReader il_reader(model_, self);
+                if (il_reader.ReadIL())
+                    std::swap(self->body_, il_reader.body());
             }
+            body_loaded_.store(true, std::memory_order_release);
         }
         
-        ParameterDefinition::ParameterDefinition(PEFileToObjectModel *model, const std::u16string &name, ITypeReference *type)
+        void MethodDefinition::ReleaseBody()
+        {
+            std::lock_guard<std::mutex> guard(body_lock_);
+            body_ = ILBody();
+            locals_.clear();
+            locals_.shrink_to_fit();
+            method_il_ = nullptr;
+            body_arena_.reset();
+            body_loaded_.store(false, std::memory_order_release);
+        }
+        
+        ParameterDefinition::ParameterDefinition(PEFileToObjectModel *model, Atom name, ITypeReference *type)
         : DefinitionBase(model)
         , name_(name)
         , type_(type)
         {}
-        
-        CILOperation::CILOperation(Opcode opcode, int offset, const ILOperand &operand)
-        : opcode_(opcode)
-        , offset_(offset)
-        , operand_(operand)
-        {}
+
 
     }
 }
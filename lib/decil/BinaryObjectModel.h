@@ -12,6 +12,12 @@
 #include "MetadataTable.h"
 #include "silk/decil/ObjectModel.h"
 
+#include "silk/Support/Arena.h"
+
+#include <llvm/ADT/OwningPtr.h>
+
+#include <atomic>
+#include <mutex>
 #include <string>
 
 namespace silk
@@ -40,11 +46,11 @@ namespace silk
             PEFileToObjectModel *model_;
         };
         
-        class TypeBase : virtual public INamedTypeDefinition, protected DefinitionBase
+        class TypeBase : public INamedTypeDefinition, protected DefinitionBase
         {
         public:
             friend class PEFileToObjectModel;
-            TypeBase(PEFileToObjectModel *model, const TypeDefinition *type_def, const std::u16string &mangled_name);
+            TypeBase(Kind kind, PEFileToObjectModel *model, const TypeDefinition *type_def, Atom mangled_name);
             virtual IFieldDefinition** field_begin() override final
             { return &fields_.front(); }
             virtual IFieldDefinition** field_end() override final
@@ -58,7 +64,7 @@ namespace silk
             virtual IGenericTypeParameter** generic_end() override final
             { return &generic_params_.back() + 1; }
             
-            virtual const std::u16string &name() override
+            virtual Atom name() override
             { return mangled_name_; }
             
             virtual ITypeReference *base_class() const override final;
@@ -66,12 +72,13 @@ namespace silk
             { return packing_size_; }
             virtual uint32_t class_size() const override final
             { return class_size_; }
-
+            virtual ITypeDefinition *owning_type() override
+            { return nullptr; }
 
         protected:
             const TypeDefinition *type_def_;
-            std::u16string mangled_name_;
-            mutable ITypeReference *base_class_;
+            Atom mangled_name_;
+            mutable std::atomic<ITypeReference*> base_class_;
             std::vector<IFieldDefinition*> fields_;
             std::vector<IMethodDefinition*> methods_;
             std::vector<IGenericTypeParameter*> generic_params_;
@@ -79,7 +86,10 @@ namespace silk
             uint32_t class_size_;
         };
         
-        class SystemDefinedStructuralType : virtual public ITypeDefinition
+        // Implements the members of Interface that have no meaning for the
+        // structural types
+        template <class Interface>
+        class SystemDefinedStructuralType : public Interface
         {
         public:
             virtual ITypeReference *base_class() const override final
@@ -103,6 +113,10 @@ namespace silk
         public:
             virtual std::vector<INamedTypeDefinition*>::const_iterator all_types_begin() const override final;
             virtual std::vector<INamedTypeDefinition*>::const_iterator all_types_end() const override final;
+            virtual IMethodDefinition *entry_point() override final;
+            virtual const char *mvid() override final;
+            virtual IAssemblyReference *get_assembly_reference(size_t idx) override final;
+            virtual size_t assembly_reference_size() override final;
             Assembly(PEFileToObjectModel *model, const AssemblyIdentity &id);
             virtual const AssemblyIdentity &identity() const override
             { return id_; }
@@ -120,6 +134,7 @@ namespace silk
         private:
             IHost *host_;
             AssemblyIdentity id_;
+            std::atomic<IAssembly*> resolved_assembly_;
         };
         
         class NonGenericNamespaceType : public TypeBase
@@ -140,7 +155,7 @@ namespace silk
             const TypeCode type_code_;
         };
         
-        class NonGenericNestedType : public INestedType, public TypeBase
+        class NonGenericNestedType : public TypeBase
         {
         public:
             NonGenericNestedType(PEFileToObjectModel *model, const TypeDefinition *e, unsigned owning_type_idx);
@@ -149,11 +164,12 @@ namespace silk
             virtual TypeCode type_code() const override final
             { return TypeCode::NotPrimitive; }
             
-            const std::u16string &name() override final;
+            Atom name() override final;
 
         private:
-            mutable ITypeDefinition *owning_type_;
+            std::atomic<ITypeDefinition*> owning_type_;
             unsigned owning_type_idx_;
+            std::once_flag name_built_;
         };
         
         class TypeReference : public ITypeReference
@@ -168,36 +184,40 @@ namespace silk
                 kAssemblyRef,
             };
             Scope type_;
-            ITypeDefinition *resolved_type_;
+            std::atomic<ITypeDefinition*> resolved_type_;
             IAssemblyReference *assembly_ref_;
             const std::u16string name_;
             const std::u16string namespace_name_;
         };
         
-        class PointerType : public SystemDefinedStructuralType, public IPointerType
+        class PointerType : public SystemDefinedStructuralType<IPointerType>
         {
         public:
             PointerType(ITypeReference *target_type);
             virtual ITypeReference *target_type() override final
             { return target_type_; }
-            const std::u16string &name() override final;
+            Atom name() override final;
 
         private:
             ITypeReference *target_type_;
-            mutable std::u16string name_;
+            // The type is shared by the signatures of all assemblies
+            std::once_flag name_built_;
+            Atom name_;
         };
         
-        class VectorType : public SystemDefinedStructuralType, public IVectorType
+        class VectorType : public SystemDefinedStructuralType<IVectorType>
         {
         public:
             VectorType(ITypeReference *element_type);
             virtual ITypeReference *element_type() override final
             { return element_type_; }
-            const std::u16string &name() override final;
+            Atom name() override final;
 
         private:
             ITypeReference *element_type_;
-            mutable std::u16string name_;
+            // The type is shared by the signatures of all assemblies
+            std::once_flag name_built_;
+            Atom name_;
         };
         
         class FieldReference : public IFieldReference
@@ -205,14 +225,14 @@ namespace silk
         public:
             FieldReference(PEFileToObjectModel *model, const MemberReference *member_ref, ITypeReference *parent_ref);
             virtual IFieldDefinition *resolved_definition() override final;
-            virtual const std::u16string &name() override final
+            virtual Atom name() override final
             { return name_; }
             
         private:
             PEFileToObjectModel *model_;
-            std::u16string name_;
+            Atom name_;
             ITypeReference *parent_ref_;
-            IFieldDefinition *resolved_def_;
+            std::atomic<IFieldDefinition*> resolved_def_;
             raw_istream signauture_;
         };
         
@@ -221,14 +241,14 @@ namespace silk
         public:
             MethodReference(PEFileToObjectModel *model, const MemberReference *member_ref, ITypeReference *parent_ref);
             virtual IMethodDefinition *resolved_definition() override final;
-            virtual const std::u16string &name() override final
+            virtual Atom name() override final
             { return name_; }
             
         private:
             PEFileToObjectModel *model_;
-            std::u16string name_;
+            Atom name_;
             ITypeReference *parent_ref_;
-            IMethodDefinition *resolved_def_;
+            std::atomic<IMethodDefinition*> resolved_def_;
             raw_istream signauture_;
 
         };
@@ -239,7 +259,7 @@ namespace silk
             FieldDefinition(PEFileToObjectModel *model, const FieldDef *def, INamedTypeDefinition *containing_type);
             virtual INamedTypeDefinition *containing_type() override final
             { return containing_type_; }
-            const std::u16string &name() override final;
+            Atom name() override final;
             virtual bool is_static() const override final;
             virtual bool is_literal() const override final;
             bool has_field_rva() const;
@@ -248,10 +268,10 @@ namespace silk
             { return mapping_; }
             
         private:
-            std::u16string name_;
+            Atom name_;
             INamedTypeDefinition *containing_type_;
             uint16_t flags_;
-            ITypeReference *type_;
+            std::atomic<ITypeReference*> type_;
             raw_istream signauture_;
             raw_istream mapping_;
         };
@@ -274,7 +294,7 @@ namespace silk
         public:
             friend class PEFileToObjectModel;
             MethodDefinition(PEFileToObjectModel *model, const MethodDef *def, INamedTypeDefinition *containing_type);
-            virtual const std::u16string &name() override final
+            virtual Atom name() override final
             { return name_; }
             
             virtual bool has_this() const override final;
@@ -286,33 +306,48 @@ namespace silk
             { return containing_type_; }
 
             virtual ITypeReference *return_type() override final
-            { return return_type_; }
+            { LoadSignature(); return return_type_; }
             virtual IParameterDefinition **param_begin() override final
-            { return &params_[0]; }
+            { LoadSignature(); return &params_[0]; }
             virtual IParameterDefinition **param_end() override final
-            { return &params_.back() + 1; }
+            { LoadSignature(); return &params_.back() + 1; }
             virtual IParameterDefinition *get_param(int idx) override final
-            { return params_[idx]; }
+            { LoadSignature(); return params_[idx]; }
             
             virtual ILocalDefinition **local_begin() override final
-            { return &locals_[0]; }
+            { LoadBody(); return &locals_[0]; }
             virtual ILocalDefinition **local_end() override final
-            { return &locals_.back() + 1; }
-            ILocalDefinition *get_local(int idx) const
-            { return locals_[idx]; }
+            { LoadBody(); return &locals_.back() + 1; }
 
-            virtual IOperation **inst_begin() override final
-            { return &instructions_[0]; }
-            virtual IOperation **inst_end() override final
-            { return &instructions_.back() + 1; }
+            virtual const ILBody &body() override final
+            { LoadBody(); return body_; }
             
+            // Only valid while the body is being loaded, i.e., for ILReader
+            ILocalDefinition *get_local(int idx) const
+            { return locals_[idx]; }
+            size_t local_size() const
+            { return locals_.size(); }
             const MethodIL *method_il() const
             { return method_il_; }
             const MethodDef *method_def() const
             { return method_def_; }
-            void LoadInstructions();
+            
+            virtual void ReleaseBody() override final;
+            
+            //
+            // The signature and the body are decoded the first time they are
+            // accessed, so that methods that are never compiled only cost
+            // their MethodDef row. The decoding is safe when several threads
+            // access the same method. Releasing is not: body() and the locals
+            // are returned without holding body_lock_, thus ReleaseBody()
+            // must only be called by the thread that owns the method, e.g.,
+            // the shard that has compiled it. A released body is decoded
+            // again when it is accessed afterwards.
+            //
+            void LoadSignature() const;
+            void LoadBody() const;
         private:
-            std::u16string name_;
+            Atom name_;
             uint8_t signature_flags_;
             uint16_t flags_;
             const MethodDef *method_def_;
@@ -321,38 +356,27 @@ namespace silk
             MethodIL *method_il_;
             std::vector<IParameterDefinition*> params_;
             std::vector<ILocalDefinition*> locals_;
-            std::vector<IOperation*> instructions_;
+            ILBody body_;
+            mutable std::once_flag signature_loaded_;
+            mutable std::mutex body_lock_;
+            mutable std::atomic<bool> body_loaded_;
+            // Holds the MethodIL and the locals of the body
+            llvm::OwningPtr<Arena> body_arena_;
         };
         
         class ParameterDefinition : public IParameterDefinition, public DefinitionBase
         {
         public:
-            virtual const std::u16string &name() override final
+            virtual Atom name() override final
             { return name_; }
             virtual ITypeReference *type() override final
             { return type_; }
-            ParameterDefinition(PEFileToObjectModel *model, const std::u16string &name, ITypeReference *type);
+            ParameterDefinition(PEFileToObjectModel *model, Atom name, ITypeReference *type);
         private:
-            std::u16string name_;
+            Atom name_;
             ITypeReference *type_;
         };
-        
-        class CILOperation : public IOperation
-        {
-        public:
-            virtual Opcode opcode() const override final
-            { return opcode_; }
-            virtual int offset() const override final
-            { return offset_; }
-            virtual const ILOperand &operand() const override final
-            { return operand_; }
-            CILOperation(Opcode opcode, int offset, const ILOperand &operand);
-            
-        private:
-            Opcode opcode_;
-            int offset_;
-            ILOperand operand_;
-        };
+
     }
 }
 
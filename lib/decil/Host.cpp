@@ -9,13 +9,18 @@
 #include "Host.h"
 #include "PEFileReader.h"
 #include "MetadataTable.h"
+#include "MetadataCache.h"
 #include "PEFileToObjectModel.h"
 #include "PlatformTypes.h"
+#include "BinaryObjectModel.h"
 
 #include "silk/Support/Util.h"
+#include "silk/Support/MappedFile.h"
 
 #include <llvm/Support/FileSystem.h>
 
+#include <dirent.h>
+
 namespace silk
 {
     namespace decil
@@ -23,7 +28,18 @@ namespace silk
         using namespace llvm;
         
         IHost::~IHost() {}
-        Host::~Host() {}
+        
+        Host::~Host()
+        {
+            // Finish the background loads before the tables go away
+            pool_.reset();
+            // Files that have been read ahead but never loaded
+            for (auto &e : prefetched_files_)
+            {
+                if (e.second)
+                    delete e.second->file;
+            }
+        }
 
         IHost *CreateDefaultHost()
         {
@@ -32,37 +48,89 @@ namespace silk
 
         Host::Host()
         : platform_type_(new PlatformType(this))
+        , parallel_load_(false)
+        , pool_(new ThreadPool())
         {}
         
         IPlatformType *Host::platform_type()
         { return platform_type_; }
         
+        PointerType *Host::GetPointerType(ITypeReference *target_type)
+        {
+            std::lock_guard<std::mutex> guard(structural_types_lock_);
+            auto &ret = pointer_types_[target_type];
+            if (!ret)
+                ret = structural_types_arena_.New<PointerType>(target_type);
+            return ret;
+        }
+        
+        VectorType *Host::GetVectorType(ITypeReference *element_type)
+        {
+            std::lock_guard<std::mutex> guard(structural_types_lock_);
+            auto &ret = vector_types_[element_type];
+            if (!ret)
+                ret = structural_types_arena_.New<VectorType>(element_type);
+            return ret;
+        }
+        
         IAssembly *Host::LoadAssemblyFromPath(const std::string &path)
         {
-            OwningPtr<MemoryBuffer> buffer;
-            MemoryBuffer::getFileOrSTDIN(path, buffer);
-
-            if (!buffer)
-            {
-                error_handler_.Error("Cannot find assembly `%s'.", path.c_str());
-                return nullptr;
-            }
+            IAssembly *ret;
+            if (path_assemblies_.Lookup(path, &ret) && ret)
+                return ret;
             
-            PEFileReader *pe_file = new PEFileReader(this, buffer);
+            //
+            // The threads that wait for the lock find the assembly that has
+            // been loaded in the meantime. Under the lock, nullptr means
+            // that the file has failed to load, thus it is reported only
+            // once, or that it is being loaded by this thread.
+            //
+            std::lock_guard<std::recursive_mutex> guard(load_lock_);
+            if (path_assemblies_.Lookup(path, &ret))
+                return ret;
+            path_assemblies_.Insert(path, nullptr);
             
-            if (pe_file->state() < PEFileReader::ReaderState::kMetadata
-                || !pe_file->is_assembly())
-                return nullptr;
+            auto pe_file = TakePrefetchedFile(path);
+            if (!pe_file)
+            {
+                // Reported once below
+                ErrorHandler quiet(true);
+                auto file = MappedFile::Open(path, quiet);
+                if (!file)
+                {
+                    error_handler_.Error("Cannot find assembly `%s'.", path.c_str());
+                    return nullptr;
+                }
+                
+                pe_file = new PEFileReader(this, file);
+                
+                if (pe_file->state() < PEFileReader::ReaderState::kMetadata
+                    || !pe_file->is_assembly())
+                    return nullptr;
+                BindMetadataCache(pe_file, error_handler_);
+            }
             
             auto id = pe_file->GetAssemblyId();
             auto lookup_assembly = LookupAssembly(id);
             if (lookup_assembly)
+            {
+                path_assemblies_.Insert(path, lookup_assembly);
                 return lookup_assembly;
+            }
             
+            // Building the model resolves the referenced assemblies
+            PrefetchReferences(pe_file);
             auto pe_model = new PEFileToObjectModel(this, pe_file);
+            if (parallel_load_)
+                pe_model->LoadMethods(pool_.get());
             auto assembly = pe_model->containing_assembly();
-            assemblies_[id] = assembly;
-            loaded_assemblies_.push_back(assembly);
+            {
+                std::lock_guard<std::mutex> guard(loaded_assemblies_lock_);
+                loaded_assemblies_.push_back(assembly);
+            }
+            // Published once the model is complete
+            assemblies_.Insert(id, assembly);
+            path_assemblies_.Insert(path, assembly);
             // object_model->
             //            PEFileToObjectModel peFileToObjectModel = new PEFileToObjectModel(this, peFileReader, moduleIdentity, null, this.metadataReaderHost.PointerSize);
             //            this.LoadedModule(peFileToObjectModel.Module);
@@ -78,7 +146,17 @@ namespace silk
         }
         IAssembly *Host::LoadAssembly(const std::string &file)
         {
-            for (auto &path : class_paths_)
+            // Only the top level of each class path is indexed
+            if (file.find('/') == std::string::npos)
+                return LoadAssemblyFromIndex(file);
+            
+            std::list<std::string> class_paths;
+            {
+                std::lock_guard<std::mutex> guard(class_path_lock_);
+                class_paths = class_paths_;
+            }
+            
+            for (auto &path : class_paths)
             {
                 std::string full_path_name = path + "/" + file;
                 if (sys::fs::exists(full_path_name))
@@ -89,31 +167,167 @@ namespace silk
         
         IAssembly *Host::LoadAssembly(const AssemblyIdentity &id)
         {
-            std::string u8name = ToUTF8String(id.name());
-            for (auto &path : class_paths_)
-            {
-                std::string full_path_name = path + "/" + u8name + ".dll";
-                if (sys::fs::exists(full_path_name))
-                    return LoadAssemblyFromPath(full_path_name);
-            }
-            return nullptr;
+            auto assembly = LookupAssembly(id);
+            if (assembly)
+                return assembly;
+            
+            return LoadAssemblyFromIndex(ToUTF8String(id.name()) + ".dll");
+        }
+        
+        IAssembly *Host::LoadAssemblyFromIndex(const std::string &file)
+        {
+            std::string path;
+            if (!FindInClassPath(file, &path))
+                return nullptr;
+            return LoadAssemblyFromPath(path);
+        }
+        
+        bool Host::FindInClassPath(const std::string &file, std::string *path)
+        {
+            std::lock_guard<std::mutex> guard(class_path_lock_);
+            auto it = class_path_files_.find(file);
+            if (it == class_path_files_.end())
+                return false;
+            *path = it->second;
+            return true;
         }
         
         IAssembly *Host::get_assembly(int idx)
-        { return loaded_assemblies_.at(idx); }
+        {
+            std::lock_guard<std::mutex> guard(loaded_assemblies_lock_);
+            return loaded_assemblies_.at(idx);
+        }
         
         size_t Host::assembly_size() const
-        { return loaded_assemblies_.size(); }
+        {
+            std::lock_guard<std::mutex> guard(loaded_assemblies_lock_);
+            return loaded_assemblies_.size();
+        }
         
         void Host::AddClassPath(const std::string &path)
         {
+            std::lock_guard<std::mutex> guard(class_path_lock_);
             class_paths_.push_back(path);
+            IndexClassPath(path);
+        }
+        
+        void Host::SetMetadataCache(const std::string &dir)
+        {
+            metadata_cache_dir_ = dir;
+        }
+        
+        void Host::SetParallelLoad(bool enabled)
+        {
+            parallel_load_ = enabled;
+        }
+        
+        void Host::BindMetadataCache(PEFileReader *file, ErrorHandler &eh)
+        {
+            if (metadata_cache_dir_.empty() || LoadMetadataCache(metadata_cache_dir_, file))
+                return;
+            
+            // Tables that fail to decode are not worth caching
+            if (!eh.has_error())
+                StoreMetadataCache(metadata_cache_dir_, file, eh);
+        }
+        
+        void Host::IndexClassPath(const std::string &path)
+        {
+            DIR *dir = opendir(path.c_str());
+            if (!dir)
+                return;
+            
+            while (auto ent = readdir(dir))
+            {
+                std::string file = ent->d_name;
+                if (file == "." || file == "..")
+                    continue;
+                class_path_files_.insert(std::make_pair(file, path + "/" + file));
+            }
+            closedir(dir);
+        }
+        
+        void Host::PrefetchReferences(PEFileReader *file)
+        {
+            for (auto &e : file->GetMDTable<AssemblyRef>())
+                PrefetchAssembly(file->GetUTF8String(e.Name).str() + ".dll");
+        }
+        
+        void Host::PrefetchAssembly(const std::string &file)
+        {
+            std::string path;
+            if (!FindInClassPath(file, &path))
+                return;
+            
+            auto prefetched = std::make_shared<PrefetchedFile>();
+            {
+                std::lock_guard<std::mutex> guard(prefetch_lock_);
+                if (!prefetched_files_.insert(std::make_pair(path, prefetched)).second)
+                    return;
+            }
+            
+            pool_->Async([this, path, prefetched]() {
+                ReadPrefetchedFile(path, prefetched.get());
+            });
+        }
+        
+        void Host::ReadPrefetchedFile(const std::string &path, PrefetchedFile *prefetched)
+        {
+            auto &eh = prefetched->error_handler;
+            auto file = MappedFile::Open(path, eh);
+            if (file)
+            {
+                auto pe_file = new PEFileReader(this, file, &eh);
+                if (pe_file->state() == PEFileReader::ReaderState::kMetadata
+                    && pe_file->is_assembly())
+                {
+                    // The tables read from the cache need no decoding
+                    BindMetadataCache(pe_file, eh);
+                    // Decode the tables that PEFileToObjectModel walks
+                    pe_file->GetMDTable<TypeDefinition>().LoadAll();
+                    pe_file->GetMDTable<FieldDef>().LoadAll();
+                    pe_file->GetMDTable<MethodDef>().LoadAll();
+                    pe_file->GetMDTable<ParamDef>().LoadAll();
+                    pe_file->GetMDTable<ExportedType>().LoadAll();
+                    
+                    if (!eh.has_error())
+                    {
+                        PrefetchReferences(pe_file);
+                        prefetched->file = pe_file;
+                    }
+                }
+                
+                if (!prefetched->file)
+                    delete pe_file;
+            }
+            prefetched->ready.set_value();
+        }
+        
+        PEFileReader *Host::TakePrefetchedFile(const std::string &path)
+        {
+            std::shared_ptr<PrefetchedFile> prefetched;
+            {
+                std::lock_guard<std::mutex> guard(prefetch_lock_);
+                // Keep the entry so that the path is never read again
+                auto &entry = prefetched_files_[path];
+                prefetched.swap(entry);
+            }
+            
+            if (!prefetched)
+                return nullptr;
+            
+            prefetched->ready.get_future().wait();
+            auto pe_file = prefetched->file;
+            // A failed background load is redone to report its errors
+            if (pe_file)
+                pe_file->set_error_handler(&error_handler_);
+            return pe_file;
         }
         
         IAssembly *Host::LookupAssembly(const AssemblyIdentity &id) const
         {
-            auto it = assemblies_.find(id);
-            return it == assemblies_.end() ? nullptr : it->second;
+            IAssembly *ret;
+            return assemblies_.Lookup(id, &ret) ? ret : nullptr;
         }
     }
 }
@@ -11,11 +11,16 @@
 
 #include "silk/decil/IHost.h"
 #include "silk/decil/Units.h"
+#include "silk/Support/Arena.h"
+#include "silk/Support/ConcurrentMap.h"
+#include "silk/Support/ThreadPool.h"
 
 #include <llvm/ADT/OwningPtr.h>
-#include <llvm/Support/MemoryBuffer.h>
 
+#include <future>
 #include <list>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <unordered_map>
 
@@ -25,7 +30,15 @@ namespace silk
     {
         class PEFileReader;
         class PlatformType;
+        class PointerType;
+        class VectorType;
         
+        //
+        // The host can be shared by several threads. The assemblies that
+        // have been loaded are looked up without waiting for the others,
+        // while loading itself is serialized, thus every file is parsed
+        // exactly once no matter how many threads ask for it.
+        //
         class Host : public IHost
         {
         public:
@@ -34,21 +47,97 @@ namespace silk
             IAssembly *LoadAssembly(const std::string &file) override final;
             virtual IAssembly *LoadAssembly(const AssemblyIdentity &id) override final;
 
+            // The class paths are read by the background loads as well,
+            // thus a path added during a load may or may not be seen by it.
             virtual void AddClassPath(const std::string &path) override final;
+            // The cache is read and written by the background loads as well
+            virtual void SetMetadataCache(const std::string &dir) override final;
+            virtual void SetParallelLoad(bool enabled) override final;
 
             virtual IPlatformType *platform_type() override final;
             
             virtual IAssembly *get_assembly(int idx) override final;
             virtual size_t assembly_size() const override final;
 
+            //
+            // The structural types are unique per target reference, i.e.,
+            // the signatures that refer to T through the same TypeDef or
+            // TypeRef share one object. T* and T[] that are reached through
+            // different references are different objects, thus they have
+            // to be compared by their resolved targets. Resolving them here
+            // would load assemblies while the signatures are decoded on
+            // several threads during a parallel load.
+            //
+            PointerType *GetPointerType(ITypeReference *target_type);
+            VectorType *GetVectorType(ITypeReference *element_type);
+
         private:
             IAssembly *LoadAssemblyFromPath(const std::string &path);
             IAssembly *LookupAssembly(const AssemblyIdentity &id) const;
+            IAssembly *LoadAssemblyFromIndex(const std::string &file);
+            // Called with class_path_lock_ held
+            void IndexClassPath(const std::string &path);
+            bool FindInClassPath(const std::string &file, std::string *path);
+            // Reads the tables from the metadata cache, or writes the cache
+            // when it is missing or stale.
+            void BindMetadataCache(PEFileReader *file, ErrorHandler &eh);
+            
+            //
+            // Referenced assemblies are read on the thread pool as soon as
+            // the assembly that refers to them has been read. A background
+            // load maps the file, parses the headers and decodes the tables
+            // that the object model reads. The object model itself is still
+            // built on the calling thread, which waits only when the file
+            // has not been read yet.
+            //
+            struct PrefetchedFile
+            {
+                PrefetchedFile()
+                : error_handler(true)
+                , file(nullptr)
+                {}
+                // Errors are reported again when the file is loaded
+                // synchronously, thus the background load stays quiet.
+                ErrorHandler error_handler;
+                PEFileReader *file;
+                std::promise<void> ready;
+            };
+            void PrefetchReferences(PEFileReader *file);
+            void PrefetchAssembly(const std::string &file);
+            void ReadPrefetchedFile(const std::string &path, PrefetchedFile *prefetched);
+            PEFileReader *TakePrefetchedFile(const std::string &path);
             
+            std::mutex class_path_lock_;
             std::list<std::string> class_paths_;
-            std::unordered_map<AssemblyIdentity, IAssembly*> assemblies_;
+            //
+            // The class paths are listed once when they are added, which
+            // maps the name of each file to its full path. The first class
+            // path that contains a file wins.
+            //
+            std::unordered_map<std::string, std::string> class_path_files_;
+            // The assembly loaded from each path, or nullptr when the load
+            // has failed or is still in progress
+            ConcurrentMap<std::string, IAssembly*> path_assemblies_;
+            ConcurrentMap<AssemblyIdentity, IAssembly*> assemblies_;
+            // Held while an assembly is being loaded, which loads the
+            // assemblies that it refers to on the same thread.
+            std::recursive_mutex load_lock_;
+            mutable std::mutex loaded_assemblies_lock_;
             std::vector<IAssembly*> loaded_assemblies_;
             PlatformType *platform_type_;
+            std::string metadata_cache_dir_;
+            bool parallel_load_;
+            
+            std::mutex structural_types_lock_;
+            std::unordered_map<ITypeReference*, PointerType*> pointer_types_;
+            std::unordered_map<ITypeReference*, VectorType*> vector_types_;
+            Arena structural_types_arena_;
+            
+            std::mutex prefetch_lock_;
+            // Paths that are read or being read, nullptr once they are taken.
+            // The files that are never taken are deleted with the host.
+            std::unordered_map<std::string, std::shared_ptr<PrefetchedFile> > prefetched_files_;
+            llvm::OwningPtr<ThreadPool> pool_;
         };
     }
 }
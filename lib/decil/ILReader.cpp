@@ -12,449 +12,304 @@
 #include "PEFileToObjectModel.h"
 
 #include "silk/Support/ErrorHandler.h"
+#include "silk/Support/Util.h"
 
 #include <llvm/ADT/OwningPtr.h>
 
+#include <algorithm>
+#include <cstring>
+
 namespace silk
 {
     namespace decil
     {
+        namespace
+        {
+            // Size of the inline operand, indexed by OperandType. The
+            // targets of switch follow the count.
+            constexpr uint8_t kOperandSize[] = {
+                0, 0, 1, 2, 1, 2, 0, 0, 0, 1, 4, 8, 4, 8, 4, 4, 4, 4, 4, 4, 1, 4, 4,
+            };
+            static_assert(sizeof(kOperandSize) == kInlineSwitch + 1, "Missing operand sizes");
+
+            struct OpcodeInfo
+            {
+                uint16_t opcode;
+                OperandType operand;
+                uint8_t operand_size;
+                FlowControl flow;
+            };
+
+#define OPCODE_INFO(name, operand, flow) { k##name, k##operand, kOperandSize[k##operand], kFlow##flow },
+            constexpr OpcodeInfo kOpcodes[] = {
+#define CIL_OPCODE(name, code, operand, flow) OPCODE_INFO(name, operand, flow)
+#define CIL_LONG_OPCODE(name, code, operand, flow)
+#include "silk/decil/Opcodes.def"
+            };
+
+            constexpr OpcodeInfo kLongOpcodes[] = {
+#define CIL_OPCODE(name, code, operand, flow)
+#define CIL_LONG_OPCODE(name, code, operand, flow) OPCODE_INFO(name, operand, flow)
+#include "silk/decil/Opcodes.def"
+            };
+#undef OPCODE_INFO
+
+            constexpr OpcodeInfo kInvalidOpcode = { kNop, kInlineInvalid, 0, kFlowNext };
+            constexpr unsigned kOpcodeCount = sizeof(kOpcodes) / sizeof(kOpcodes[0]);
+            constexpr unsigned kLongOpcodeCount = sizeof(kLongOpcodes) / sizeof(kLongOpcodes[0]);
+
+            // The opcodes are looked up by their codes
+            constexpr bool IsDense(const OpcodeInfo *info, unsigned count, unsigned prefix, unsigned i = 0)
+            {
+                return i == count || (info[i].opcode == (prefix | i) && IsDense(info, count, prefix, i + 1));
+            }
+            static_assert(IsDense(kOpcodes, kOpcodeCount, 0), "Opcodes.def has holes");
+            static_assert(IsDense(kLongOpcodes, kLongOpcodeCount, kLongOpcodePrefix << 8), "Opcodes.def has holes");
+
+            // The next instruction starts a new basic block
+            constexpr bool EndsBasicBlock(FlowControl flow)
+            {
+                return flow == kFlowBranch || flow == kFlowCondBranch || flow == kFlowReturn || flow == kFlowThrow;
+            }
+
+            // The IL is not aligned
+            template <class T>
+            T Read(const uint8_t *p)
+            {
+                T v;
+                memcpy(&v, p, sizeof(T));
+                return v;
+            }
+
+            MDToken ReadToken(const uint8_t *p)
+            {
+                auto v = Read<uint32_t>(p);
+                return MDToken(v >> 24, v);
+            }
+        }
+
         ILReader::ILReader(PEFileToObjectModel *model, MethodDefinition *method)
         : model_(model)
         , method_(method)
+        , params_(nullptr)
+        , param_count_(0)
         {}
         
-        void ILReader::ReadIL()
+        bool ILReader::ReadIL()
         {
-            PopulateCILInstructions();
+            // get_param() would check the signature for every ldarg
+            params_ = method_->param_begin();
+            param_count_ = method_->param_end() - params_;
+            int offset = PopulateCILInstructions();
+            if (offset < 0)
+                return true;
+            
+            // A partial body would be compiled into broken code
+            body_ = ILBody();
+            model_->file()->error_handler().Error("Invalid IL at offset %d of method `%s'.",
+                                                  offset, ToUTF8String(method_->name().str()).c_str());
+            return false;
         }
         
-        void ILReader::PopulateCILInstructions()
+        int ILReader::PopulateCILInstructions()
         {
-            raw_istream is = method_->method_il()->EncodedILMemoryBlock;
-            char i8;
-            int16_t i16;
-            int32_t i32;
-            int64_t i64;
-            float float4;
-            double double8;
-            MDToken token;
+            auto &il = method_->method_il()->EncodedILMemoryBlock;
+            auto start = reinterpret_cast<const uint8_t*>(il.start());
+            auto end = reinterpret_cast<const uint8_t*>(il.end());
+            int code_size = end - start;
+
+            std::vector<int> targets;
+            // Targets outside of the code would be blocks without any
+            // instruction
+            auto add_block_start = [this, code_size](int pos) {
+                if (pos < 0 || pos >= code_size)
+                    return false;
+                body_.AddBlockStart(pos);
+                return true;
+            };
+            add_block_start(0);
             
-            while (!is.eof())
+            const OpcodeInfo *info = &kInvalidOpcode;
+
+            for (auto p = start; p < end;)
             {
-                ILOperand operand;
-                int offset = (int)is.tellg();
-                auto opcode = GetOpcode(is);
+                int offset = p - start;
+                unsigned code = *p++;
+                if (code == kLongOpcodePrefix)
+                {
+                    code = p < end ? *p++ : kLongOpcodeCount;
+                    info = code < kLongOpcodeCount ? &kLongOpcodes[code] : &kInvalidOpcode;
+                }
+                else
+                {
+                    info = code < kOpcodeCount ? &kOpcodes[code] : &kInvalidOpcode;
+                }
 
-                switch (opcode)
+                // Bounds of the operand, which are variable for switch
+                bool valid = info->operand != kInlineInvalid && info->operand_size <= end - p;
+                auto next = valid ? p + info->operand_size : end;
+                if (valid && info->operand == kInlineSwitch)
                 {
-                    case kNop:
-                    case kBreak:
-                        break;
+                    uint32_t count = Read<uint32_t>(p);
+                    valid = count <= static_cast<size_t>(end - next) / sizeof(int32_t);
+                    next += valid ? count * sizeof(int32_t) : 0;
+                }
+                if (!valid)
+                    return offset;
 
-                    case kLdarg_0:
-                    case kLdarg_1:
-                    case kLdarg_2:
-                    case kLdarg_3:
-                        operand.SetMetadata(GetParameter((int)opcode - kLdarg_0));
-                        break;
-                        
-                    case kLdloc_0:
-                    case kLdloc_1:
-                    case kLdloc_2:
-                    case kLdloc_3:
-                        operand.SetMetadata(GetLocal((int)opcode - kLdloc_0));
-                        break;
-                        
-                    case kStloc_0:
-                    case kStloc_1:
-                    case kStloc_2:
-                    case kStloc_3:
-                        operand.SetMetadata(GetLocal((int)opcode - kStloc_0));
-                        break;
-                        
-                    case kLdarg_s:
-                    case kLdarga_s:
-                    case kStarg_s:
-                        is >> i8;
-                        operand.SetMetadata(GetParameter(i8));
+                auto opcode = static_cast<Opcode>(info->opcode);
+                ILOperand operand;
+                switch (info->operand)
+                {
+                    case kInlineNone:
+                    case kInlineInvalid:
                         break;
-                    case kLdloc_s:
-                    case kLdloca_s:
-                    case kStloc_s:
-                        is >> i8;
-                        operand.SetMetadata(GetLocal(i8));
+
+                    // The indices of the arguments and the locals are
+                    // out of range in malformed IL
+                    case kShortInlineArg:
+                    case kInlineArg:
+                    case kMacroArg:
+                    {
+                        int idx = info->operand == kMacroArg ? opcode - kLdarg_0
+                            : info->operand == kShortInlineArg ? *p : Read<uint16_t>(p);
+                        auto param = GetParameter(idx);
+                        if (!param)
+                            return offset;
+                        if (info->operand != kMacroArg && opcode != kLdarg_s && opcode != kLdarg)
+                            body_.AddMemoryParam(param);
+                        operand.SetMetadata(param);
+                    }
                         break;
-                    case kLdnull:
+
+                    case kShortInlineVar:
+                    case kInlineVar:
+                    case kMacroVar:
+                    {
+                        int idx = info->operand == kShortInlineVar ? *p
+                            : info->operand == kInlineVar ? Read<uint16_t>(p)
+                            : opcode < kStloc_0 ? opcode - kLdloc_0 : opcode - kStloc_0;
+                        auto local = GetLocal(idx);
+                        if (!local)
+                            return offset;
+                        operand.SetMetadata(local);
+                    }
                         break;
-                    case kLdc_i4_m1:
-                    case kLdc_i4_0:
-                    case kLdc_i4_1:
-                    case kLdc_i4_2:
-                    case kLdc_i4_3:
-                    case kLdc_i4_4:
-                    case kLdc_i4_5:
-                    case kLdc_i4_6:
-                    case kLdc_i4_7:
-                    case kLdc_i4_8:
+
+                    case kMacroI4:
                         operand.SetInt((int)opcode - kLdc_i4_0);
                         break;
-                    case kLdc_i4_s:
-                        is >> i8;
-                        operand.SetInt(i8);
-                        break;
-                    case kLdc_i4:
-                        is >> i32;
-                        operand.SetInt(i32);
+                    case kShortInlineI:
+                        operand.SetInt(Read<int8_t>(p));
                         break;
-                    case kLdc_i8:
-                        is >> i64;
-                        operand.SetInt(i64);
+                    case kInlineI:
+                        operand.SetInt(Read<int32_t>(p));
                         break;
-                    case kLdc_r4:
-                        is >> float4;
-                        operand.SetFloat(float4);
+                    case kInlineI8:
+                        operand.SetInt(Read<int64_t>(p));
                         break;
-                    case kLdc_r8:
-                        is >> double8;
-                        operand.SetDouble(double8);
-                        break;
-                    case kDup:
-                    case kPop:
-                        break;
-                    case kJmp:
-                        is >> i32;
-                        operand.SetInt(i32);
-                        break;
-                    case kCall:
-                        is >> token;
-                        operand.SetMetadata(GetMethod(&token));
+                    case kShortInlineR:
+                        operand.SetFloat(Read<float>(p));
                         break;
-//                    case kCalli:
-//                        value = this.GetFunctionPointerType(memReader.ReadUInt32());
-//                        break;
-                    case kRet:
+                    case kInlineR:
+                        operand.SetDouble(Read<double>(p));
                         break;
-                    case kBr_s:
-                    case kBrfalse_s:
-                    case kBrtrue_s:
-                    case kBeq_s:
-                    case kBge_s:
-                    case kBgt_s:
-                    case kBle_s:
-                    case kBlt_s:
-                    case kBne_un_s:
-                    case kBge_un_s:
-                    case kBgt_un_s:
-                    case kBle_un_s:
-                    case kBlt_un_s:
-                        is >> i8;
-                        operand.SetInt(i8 + 2 + offset);
-                        break;
-                    case kBr:
-                    case kBrfalse:
-                    case kBrtrue:
-                    case kBeq:
-                    case kBge:
-                    case kBgt:
-                    case kBle:
-                    case kBlt:
-                    case kBne_un:
-                    case kBge_un:
-                    case kBgt_un:
-                    case kBle_un:
-                    case kBlt_un:
-                        is >> i32;
-                        operand.SetInt(i32 + 5 + offset);
-                        break;
-                    case kSwitch:
+
+                    case kInlineMethod:
                     {
-                        is >> i32;
-                        auto num_targets = i32;
-                        std::vector<int> targets;
-                        targets.reserve(num_targets);
-                        auto off = (int)offset + num_targets * 4 + 5;
-                        for (auto i = 0; i < num_targets; ++i)
-                        {
-                            is >> i32;
-                            targets.push_back(i32 + off);
-                        }
-                        operand.SetIntArray(targets);
-                    }
-                        break;
-                    case kLdind_i1:
-                    case kLdind_u1:
-                    case kLdind_i2:
-                    case kLdind_u2:
-                    case kLdind_i4:
-                    case kLdind_u4:
-                    case kLdind_i8:
-                    case kLdind_i:
-                    case kLdind_r4:
-                    case kLdind_r8:
-                    case kLdind_ref:
-                    case kStind_ref:
-                    case kStind_i1:
-                    case kStind_i2:
-                    case kStind_i4:
-                    case kStind_i8:
-                    case kStind_r4:
-                    case kStind_r8:
-                    case kAdd:
-                    case kSub:
-                    case kMul:
-                    case kDiv:
-                    case kDiv_un:
-                    case kRem:
-                    case kRem_un:
-                    case kAnd:
-                    case kOr:
-                    case kXor:
-                    case kShl:
-                    case kShr:
-                    case kShr_un:
-                    case kNeg:
-                    case kNot:
-                    case kConv_i1:
-                    case kConv_i2:
-                    case kConv_i4:
-                    case kConv_i8:
-                    case kConv_r4:
-                    case kConv_r8:
-                    case kConv_u4:
-                    case kConv_u8:
-                        break;
-                    case kCallvirt:
-                        is >> token;
+                        auto token = ReadToken(p);
                         operand.SetMetadata(GetMethod(&token));
+                    }
                         break;
-                        
-                    case kCpobj:
-                    case kLdobj:
-                        is >> token;
-                        operand.SetMetadata(GetType(&token));
-                        break;
-                    case kLdstr:
-                        is >> token;
-                        operand.SetString(GetUserStringForToken(&token));
-                        break;
-                    case kNewobj:
-                        is >> token;
-                        operand.SetMetadata(GetMethod(&token));
-                        break;
-                    case kCastclass:
-                    case kIsinst:
-                        is >> token;
-                        operand.SetMetadata(GetType(&token));
-                        break;
-                    case kConv_r_un:
-                        break;
-                    case kUnbox:
-                        is >> token;
-                        operand.SetMetadata(GetType(&token));
-                        break;
-                    case kThrow:
-                        break;
-                    case kLdfld:
-                    case kLdflda:
-                    case kStfld:
-                        is >> token;
-                        operand.SetMetadata(GetField(&token));
-                        break;
-                    case kLdsfld:
-                    case kLdsflda:
-                    case kStsfld:
-                        is >> token;
+                    case kInlineField:
+                    {
+                        auto token = ReadToken(p);
                         operand.SetMetadata(GetField(&token));
+                    }
                         break;
-                    case kStobj:
-                        is >> token;
-                        operand.SetMetadata(GetType(&token));
-                        break;
-                    case kConv_ovf_i1_un:
-                    case kConv_ovf_i2_un:
-                    case kConv_ovf_i4_un:
-                    case kConv_ovf_i8_un:
-                    case kConv_ovf_u1_un:
-                    case kConv_ovf_u2_un:
-                    case kConv_ovf_u4_un:
-                    case kConv_ovf_u8_un:
-                    case kConv_ovf_i_un:
-                    case kConv_ovf_u_un:
-                        break;
-                    case kBox:
-                        is >> token;
-                        operand.SetMetadata(GetType(&token));
-                        break;
-                    case kNewarr:
-                        is >> token;
-                        operand.SetMetadata(GetType(&token));
-                        break;
-                    case kLdlen:
-                        break;
-                    case kLdelema:
-                        is >> token;
-                        operand.SetMetadata(GetType(&token));
-                        break;
-                    case kLdelem_i1:
-                    case kLdelem_u1:
-                    case kLdelem_i2:
-                    case kLdelem_u2:
-                    case kLdelem_i4:
-                    case kLdelem_u4:
-                    case kLdelem_i8:
-                    case kLdelem_i:
-                    case kLdelem_r4:
-                    case kLdelem_r8:
-                    case kLdelem_ref:
-                    case kStelem_i:
-                    case kStelem_i1:
-                    case kStelem_i2:
-                    case kStelem_i4:
-                    case kStelem_i8:
-                    case kStelem_r4:
-                    case kStelem_r8:
-                    case kStelem_ref:
-                        break;
-                    case kLdelem:
-                    case kStelem:
-                    case kUnbox_any:
-                        is >> token;
-                        operand.SetMetadata(GetType(&token));
-                        break;
-                    case kConv_ovf_i1:
-                    case kConv_ovf_u1:
-                    case kConv_ovf_i2:
-                    case kConv_ovf_u2:
-                    case kConv_ovf_i4:
-                    case kConv_ovf_u4:
-                    case kConv_ovf_i8:
-                    case kConv_ovf_u8:
-                        break;
-                    case kRefanyval:
-                        is >> token;
-                        operand.SetMetadata(GetType(&token));
-                        break;
-                    case kCkfinite:
-                        break;
-                    case kMkrefany:
-                        is >> token;
+                    case kInlineType:
+                    {
+                        auto token = ReadToken(p);
                         operand.SetMetadata(GetType(&token));
+                    }
                         break;
-                    case kLdtoken:
-                        is >> token;
+                    case kInlineTok:
+                    {
+                        auto token = ReadToken(p);
                         operand.SetMetadata(GetRuntimeHandleFromToken(&token));
+                    }
                         break;
-                        
-                    case kConv_u2:
-                    case kConv_u1:
-                    case kConv_i:
-                    case kConv_ovf_i:
-                    case kConv_ovf_u:
-                    case kAdd_ovf:
-                    case kAdd_ovf_un:
-                    case kMul_ovf:
-                    case kMul_ovf_un:
-                    case kSub_ovf:
-                    case kSub_ovf_un:
-                    case kEndfinally:
-                        break;
-                    case kLeave:
-                        is >> i32;
-                        operand.SetInt(offset + 5 + i32);
-                        break;
-                    case kLeave_s:
-                        is >> i8;
-                        operand.SetInt(offset + 2 + i8);
-                        break;
-                    case kStind_i:
-                    case kConv_u:
-                    case kArglist:
-                    case kCeq:
-                    case kCgt:
-                    case kCgt_un:
-                    case kClt:
-                    case kClt_un:
-                        break;
-                    case kLdftn:
-                    case kLdvirtftn:
-                        is >> token;
-                        operand.SetMetadata(GetMethod(&token));
-                        break;
-                    case kLdarg:
-                    case kLdarga:
-                    case kStarg:
-                        is >> i16;
-                        operand.SetMetadata(GetParameter(i16));
-                        break;
-                    case kLdloc:
-                    case kLdloca:
-                    case kStloc:
-                        is >> i16;
-                        operand.SetInt(i16);
-                        break;
-                    case kLocalloc:
-                        break;
-                    case kEndfilter:
-                        break;
-                    case kUnaligned_:
-                        is >> i8;
-                        operand.SetInt(i8);
-                        break;
-                    case kVolatile_:
-                    case kTail_:
-                        break;
-                    case kInitobj:
-                    case kConstrained_:
-                        is >> token;
-                        operand.SetMetadata(GetType(&token));
-                        break;
-                    case kCpblk:
-                    case kInitblk:
-                        break;
-                    case kNo_:
-                        is >> i8;
-                        operand.SetInt(i8);
+                    case kInlineString:
+                    {
+                        auto token = ReadToken(p);
+                        operand.SetString(body_.AddString(GetUserStringForToken(&token)));
+                    }
                         break;
-                    case kRethrow:
+                    case kInlineSig:
+                        // The stand-alone signature of calli is not decoded yet
+                        operand.SetInt(Read<uint32_t>(p));
                         break;
-                    case kSizeof:
-                        is >> token;
-                        operand.SetMetadata(GetType(&token));
-                        break;
-                    case kRefanytype:
-                    case kReadonly_:
+
+                    // The targets are relative to the next instruction
+                    case kShortInlineBrTarget:
+                    case kInlineBrTarget:
+                    {
+                        int target = next - start;
+                        target += info->operand == kShortInlineBrTarget ? Read<int8_t>(p) : Read<int32_t>(p);
+                        if (!add_block_start(target))
+                            return offset;
+                        operand.SetInt(target);
+                    }
                         break;
-                    default:
-                        assert (0 && "Unimplemented opcode");
+                    case kInlineSwitch:
+                    {
+                        uint32_t count = Read<uint32_t>(p);
+                        targets.resize(count);
+                        for (uint32_t i = 0; i < count; ++i)
+                        {
+                            targets[i] = (next - start) + Read<int32_t>(p + sizeof(int32_t) * (i + 1));
+                            if (!add_block_start(targets[i]))
+                                return offset;
+                        }
+                        operand.SetIntArray(body_.AddIntArray(targets), count);
+                    }
                         break;
                 }
-                auto inst = new CILOperation(opcode, offset, operand);
-                instructions_.push_back(inst);
+                body_.Append(opcode, offset, operand);
+                p = next;
+
+                if (EndsBasicBlock(info->flow))
+                    add_block_start(p - start);
             }
-        }
-        
-        Opcode ILReader::GetOpcode(raw_istream &is)
-        {
-            uint8_t b0, b1;
-            is >> b0;
             
-            if (b0 == kLongOpcodePrefix) {
-                is >> b1;
-                return (Opcode)((b0 << 8) | b1);
-            } else {
-                return (Opcode)b0;
+            // The control must not fall off the end of the code, ECMA-335
+            // Partition III, 1.7.5
+            if (info->flow != kFlowBranch && info->flow != kFlowReturn && info->flow != kFlowThrow)
+                return code_size;
+
+            body_.Shrink();
+            
+            // Every block has to start at an instruction, both are sorted
+            auto inst = body_.begin();
+            for (auto pos : body_.block_starts())
+            {
+                while (inst != body_.end() && inst->offset() < pos)
+                    ++inst;
+                if (inst == body_.end() || inst->offset() != pos)
+                    return pos;
             }
+            return -1;
         }
         
+        // Both return nullptr for an index that is out of range
         IMetadata *ILReader::GetLocal(int idx)
         {
-            return method_->get_local(idx);
+            return size_t(idx) < method_->local_size() ? method_->get_local(idx) : nullptr;
         }
         
-        IMetadata *ILReader::GetParameter(int idx)
+        IParameterDefinition *ILReader::GetParameter(int idx)
         {
-            return method_->get_param(idx);
+            return idx < param_count_ ? params_[idx] : nullptr;
         }
         
         IMetadata *ILReader::GetMethod(const MDToken *tok)
@@ -494,12 +349,7 @@ namespace silk
         
         std::u16string ILReader::GetUserStringForToken(const MDToken *tok)
         {
-            ErrorHandler eh;
-            raw_istream dummy;
-            MDLoader loader(model_->file(), dummy, eh);
-            MDString str;
-            loader.LoadUserString(&str, *tok);
-            return (std::u16string)str;
+            return model_->file()->GetUserString(*tok);
         }
     }
 }
@@ -18,29 +18,81 @@ namespace silk
         class PEFileToObjectModel;
         class MethodDefinition;
         class MDToken;
+
+        // Encoding of the inline operand, ECMA-335 Partition III, 1.9
+        enum OperandType : uint8_t
+        {
+            kInlineNone,
+            kInlineInvalid,
+            kShortInlineArg,
+            kInlineArg,
+            kShortInlineVar,
+            kInlineVar,
+            // The argument, local or constant is part of the opcode
+            kMacroArg,
+            kMacroVar,
+            kMacroI4,
+            kShortInlineI,
+            kInlineI,
+            kInlineI8,
+            kShortInlineR,
+            kInlineR,
+            kInlineMethod,
+            kInlineField,
+            kInlineType,
+            kInlineTok,
+            kInlineString,
+            kInlineSig,
+            kShortInlineBrTarget,
+            kInlineBrTarget,
+            kInlineSwitch,
+        };
+
+        enum FlowControl : uint8_t
+        {
+            kFlowNext,
+            kFlowBranch,
+            kFlowCondBranch,
+            kFlowReturn,
+            kFlowThrow,
+            kFlowCall,
+            kFlowMeta,
+            kFlowBreak,
+        };
+
+        //
+        // Decodes the IL of a method in a single pass. The operand and the
+        // control flow of each opcode are looked up in the tables generated
+        // from Opcodes.def, and the starts of the basic blocks are recorded
+        // along the way.
+        //
         class ILReader
         {
         public:
             ILReader(PEFileToObjectModel *model, MethodDefinition *method);
-            std::vector<IOperation*> & GetInstructions()
-            { return instructions_; }
-            void ReadIL();
-            
+            ILBody &body()
+            { return body_; }
+            // Fails on malformed IL, which is reported and leaves the
+            // body empty
+            bool ReadIL();
+
         private:
             void LoadLocalSignature();
-            void PopulateCILInstructions();
+            // The offset of the first malformed instruction, or -1
+            int PopulateCILInstructions();
             IMetadata *GetLocal(int idx);
-            IMetadata *GetParameter(int idx);
+            IParameterDefinition *GetParameter(int idx);
             IMetadata *GetMethod(const MDToken *tok);
             IMetadata *GetType(const MDToken *tok);
             IMetadata *GetField(const MDToken *tok);
             IMetadata *GetRuntimeHandleFromToken(const MDToken *tok);
             std::u16string GetUserStringForToken(const MDToken *tok);
-            Opcode GetOpcode(raw_istream &is);
-            
+
             PEFileToObjectModel *model_;
             MethodDefinition *method_;
-            std::vector<IOperation*> instructions_;
+            IParameterDefinition **params_;
+            int param_count_;
+            ILBody body_;
         };
     }
 }
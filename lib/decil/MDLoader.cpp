@@ -9,10 +9,9 @@
 #include "MDLoader.h"
 #include "Metadata.h"
 #include "PEFileReader.h"
-#include "silk/Support/Util.h"
- 
-#include <locale>
-#include <iostream>
+#include "silk/Support/ErrorHandler.h"
+
+#include <cassert>
 
 namespace silk
 {
@@ -23,149 +22,58 @@ namespace silk
     }
     namespace decil
     {
-        static uint32_t LowerBitMask(unsigned int i)
-        {
-            return (1 << i) - 1;
-        }
-        
-        MDTokenBase::MDTokenBase()
-        : idx_(0)
-        {}
-        
-        MDTokenBase::~MDTokenBase()
-        {}
-        
-        void MDTokenBase::LoadSimpleToken(MDLoader &loader)
-        {
-            if (loader.table(id())->is_full_id())
-            {
-                loader.stream() >> idx_;
-            }
-            else
-            {
-                uint16_t v;
-                loader.stream() >> v;
-                idx_ = v;
-            }
-        }
-        
-        int MDTokenBase::LoadCodedToken(MDLoader & loader, const int tags[], size_t tag_length, unsigned tag_bits) {
-            std::vector<int> table_ids(tags, tags + tag_length);
-            
-            bool has_big_table = false;
-            for (auto id : table_ids)
-            {
-                auto table = loader.table(id);
-                if (table && table->is_full_id())
-                {
-                    has_big_table = true;
-                    break;
-                }
-            }
-            
-            uint32_t v;
-            if (has_big_table) {
-                loader.stream() >> v;
-            } else {
-                uint16_t v1;
-                loader.stream() >> v1;
-                v = v1;
-            }
-            
-            idx_ = v >> tag_bits;
-            return table_ids.at(v & LowerBitMask(tag_bits));
-        }
-        
-        int MDTokenBase::LoadCodedToken(unsigned v, const int tags[], size_t tag_length, unsigned tag_bits)
-        {
-            std::vector<int> table_ids(tags, tags + tag_length);
-            idx_ = v >> tag_bits;
-            return table_ids.at(v & LowerBitMask(tag_bits));
-        }
-        
-        void MDToken::Load(MDLoader &) {}
         void MDToken::Load(raw_istream & is)
         {
-            uint32_t t;
-            is >> t;
-            id_ = t >> 24;
-            idx_ = t & 0xffffff;
-        }
-        
-        MDBlob::MDBlob()
-        : offset(0)
-        , size(0)
-        , data_offset(0)
-        , file(nullptr)
-        {}
-        
-        raw_istream MDBlob::to_istream() const
-        {
-            raw_istream is = file->md_stream(PEFileReader::kBlobStream);
-            is.seek(data_offset);
-            return raw_istream(is.pos(), size);
+            is >> v_;
         }
         
         MDLoader::MDLoader(PEFileReader *file, const raw_istream &is, ErrorHandler &eh)
         : file_(file)
         , is_(is)
         , eh_(eh)
+        , simple_index_sizes_(file->simple_index_sizes())
+        , coded_index_sizes_(file->coded_index_sizes())
         {}
         
         MDLoader & MDLoader::Load(MDGUID *v)
         {
             v->offset = LoadInt(mdt_header().GUIDIndexSize());
-            raw_istream &is = file_->md_stream(PEFileReader::kGUIDStream);
-            memcpy(v->guid, is.start() + v->offset, sizeof(v->guid));
+            const raw_istream &is = file_->md_stream(PEFileReader::kGUIDStream);
+            if (v->offset * 16 > is.size())
+            {
+                eh_.Error("GUID heap index %u is out of range.", v->offset);
+                v->offset = 0;
+            }
             return *this;
         }
         
         MDLoader & MDLoader::Load(MDString *v)
         {
             v->offset = LoadInt(mdt_header().StringIndexSize());
-            raw_istream &is = file_->md_stream(PEFileReader::kStringStream);
-            is.seek(v->offset);
-            
-            auto str = is.peek_utf8_null_terminated();
-            v->string = ToUTF16String(str);
+            const raw_istream &is = file_->md_stream(PEFileReader::kStringStream);
+            if (v->offset >= is.size())
+            {
+                // Index 0 is the empty string even when the heap is absent
+                if (v->offset)
+                    eh_.Error("String heap index %u is out of range.", v->offset);
+                v->offset = 0;
+            }
             return *this;
         }
         
         MDLoader & MDLoader::Load(MDBlob *v)
         {
             v->offset = LoadInt(mdt_header().BlobIndexSize());
-            raw_istream &is = file_->md_stream(PEFileReader::kBlobStream);
-            is.seek(v->offset);
-            
-            v->size = ReadBlobOrUserStringSize(is);
-            v->data_offset = is.tellg();
-            v->file = file_;
-            
-            if (v->offset == 726 && v->size == 32854)
+            const raw_istream &is = file_->md_stream(PEFileReader::kBlobStream);
+            if (v->offset >= is.size())
             {
-                std::cout << "MDLoader::Load " << v << "\n";
+                if (v->offset)
+                    eh_.Error("Blob heap index %u is out of range.", v->offset);
+                v->offset = 0;
             }
             return *this;
         }
         
-        MDLoader & MDLoader::LoadUserString(MDString *str, const MDToken &token)
-        {
-            str->offset = token.idx();
-            raw_istream & is = file_->md_stream(PEFileReader::kUserStringStream);
-            is.seek(str->offset);
-            
-            size_t size = ReadBlobOrUserStringSize(is);
-            str->string = std::u16string(reinterpret_cast<const char16_t*>(is.pos()), size / 2);
-            
-            return *this;
-        }
-        
-        MDLoader & MDLoader::Load(MDTokenBase *v)
-        {
-            v->Load(*this);
-            return *this;
-        }
-        
         uint32_t MDLoader::ReadBlobOrUserStringSize(raw_istream & is)
         {
             unsigned char b1, b2, b3, b4;
@@ -190,27 +98,8 @@ namespace silk
             }
         }
         
-        uint32_t MDLoader::LoadInt(unsigned size)
-        {
-            if (size == 2)
-            {
-                uint16_t i;
-                stream() >> i;
-                return i;
-            }
-            else
-            {
-                uint32_t dummy;
-                stream() >> dummy;
-                return dummy;
-            }
-        }
-        
         const MetadataTableHeader &MDLoader::mdt_header() const
         { return file_->mdt_header(); }
-        
-        MDTableBase *MDLoader::table(unsigned id) const
-        { return file_->table(id); }
     }
 }
 
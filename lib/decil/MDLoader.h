@@ -18,112 +18,143 @@ namespace silk
     namespace decil
     {
         class PEFileReader;
-        
+
+        //
+        // The columns below are plain values that only record where the
+        // data lives in the heaps. PEFileReader decodes them on demand
+        // through GetUTF8String(), GetString(), GetGUID() and GetBlob().
+        //
+
+        // 1-based index into the #GUID heap
         struct MDGUID
         {
             uint32_t offset;
-            char guid[16];
         };
-        
+
         struct MDString
         {
             uint32_t offset;
-            std::u16string string;
-            operator std::u16string () const { return string; }
         };
-        
+
         struct MDBlob
         {
             uint32_t offset;
-            uint32_t size;
-            std::streampos data_offset;
-            PEFileReader *file;
-            raw_istream to_istream() const;
-            MDBlob();
         };
-        
-        class MDLoader;
-        class MDTokenBase
+
+        //
+        // Token used in instructions, ECMA-335, Part III, Sec 1.9.
+        // The table id lives in the top byte and the row index in the lower
+        // 24 bits, thus a token is as large as the index it holds.
+        //
+        class MDToken
         {
         public:
-            virtual void Load(MDLoader &) = 0;
-            virtual unsigned id() const = 0;
-            unsigned idx() const { return idx_; }
-            MDTokenBase();
-            virtual ~MDTokenBase();
-            static const int kTagListSentinal = -1;
+            MDToken()
+            : v_(0)
+            {}
+            MDToken(unsigned id, unsigned idx)
+            : v_((id << 24) | (idx & kIndexMask))
+            {}
+
+            unsigned id() const  { return v_ >> 24; }
+            unsigned idx() const { return v_ & kIndexMask; }
             operator unsigned() const { return idx(); }
+            void Load(raw_istream &is);
+
+            // Same as kInvalidTableReference, which is declared in Metadata.h
+            static const unsigned kInvalidId = 0xff;
+
         protected:
-            void LoadSimpleToken(MDLoader &loader);
-            int LoadCodedToken(MDLoader &loader, const int *tags, size_t tag_length, unsigned tag_bits);
-            int LoadCodedToken(unsigned, const int *tags, size_t tag_length, unsigned tag_bits);
-            uint32_t idx_;
+            static const uint32_t kIndexMask = 0xffffff;
+            uint32_t v_;
         };
-        
+
+        // Index into the table T
         template <class T>
-        class MDSimpleToken : public MDTokenBase
+        class MDSimpleToken : public MDToken
         {
         public:
-            virtual void Load(MDLoader &loader)
-            { LoadSimpleToken(loader); }
-            virtual unsigned id() const
-            { return T::id(); }
+            void LoadFromInt(unsigned v)
+            { *static_cast<MDToken*>(this) = MDToken(T::id(), v); }
         };
-        
+
+        // Coded index, ECMA-335 Partition II, 24.2.6
         template <class T>
-        class MDCodedToken : public MDTokenBase
+        class MDCodedToken : public MDToken
         {
         public:
-            virtual unsigned id() const { return tbl_id_; }
-            
-            virtual void Load(MDLoader &loader)
-            { tbl_id_ = LoadCodedToken(loader, T::tags, T::tag_length, T::tag_bits); }
             void LoadFromInt(unsigned v)
-            { tbl_id_ = LoadCodedToken(v, T::tags, T::tag_length, T::tag_bits); }
-            
-        private:
-            uint32_t tbl_id_;
-        };
-        
-        /* Token used in instructions, ECMA-335, Part III, Sec 1.9 */
-        class MDToken : public MDTokenBase
-        {
-        public:
-            virtual void Load(MDLoader &loader);
-            void Load(raw_istream &is);
-            virtual unsigned id() const { return id_; }
-        private:
-            unsigned id_;
+            {
+                // An out-of-range tag must not alias row 0 of the Module table
+                auto tag = v & ((1 << T::tag_bits) - 1);
+                auto id = tag < T::tag_length ? unsigned(T::tags[tag]) : kInvalidId;
+                *static_cast<MDToken*>(this) = MDToken(id, v >> T::tag_bits);
+            }
         };
 
         struct MetadataTableHeader;
         class MDTableBase;
-        
+
+        //
+        // Decodes the columns of a single row. The rows describe their
+        // schema by loading each column in order, e.g.
+        //
+        //   loader.Load(&Flags).Load(&Name).Load(&Signature);
+        //
+        // which is expanded at compile time for each table.
+        //
         class MDLoader
         {
         public:
             MDLoader(PEFileReader *file, const raw_istream &is, ErrorHandler &eh);
-            
+
+            MDLoader &Load(uint16_t *v) { is_ >> *v; return *this; }
+            MDLoader &Load(uint32_t *v) { is_ >> *v; return *this; }
             MDLoader &Load(MDGUID*);
             MDLoader &Load(MDString*);
             MDLoader &Load(MDBlob*);
-            MDLoader &Load(MDTokenBase*);
-            MDLoader &LoadUserString(MDString*, const MDToken &token);
-            
+
+            template <class T>
+            MDLoader &Load(MDSimpleToken<T> *v)
+            {
+                v->LoadFromInt(LoadInt(simple_index_sizes_[T::id()]));
+                return *this;
+            }
+
+            template <class T>
+            MDLoader &Load(MDCodedToken<T> *v)
+            {
+                v->LoadFromInt(LoadInt(coded_index_sizes_[T::kind]));
+                return *this;
+            }
+
             const MetadataTableHeader & mdt_header() const;
             raw_istream &stream() { return is_; }
-            MDTableBase *table(unsigned id) const;
-            
-        private:
-            uint32_t LoadInt(unsigned size);
+            PEFileReader *file() const { return file_; }
+
             static uint32_t ReadBlobOrUserStringSize(raw_istream &is);
-            
+            uint32_t LoadInt(unsigned size)
+            {
+                if (size == 2)
+                {
+                    uint16_t v;
+                    is_ >> v;
+                    return v;
+                }
+                uint32_t v;
+                is_ >> v;
+                return v;
+            }
+
+        private:
             PEFileReader *file_;
             raw_istream is_;
             ErrorHandler &eh_;
+            const uint8_t *simple_index_sizes_;
+            const uint8_t *coded_index_sizes_;
         };
     }
-    
+
     raw_istream &operator>>(raw_istream &is, decil::MDToken &val);
 }
 
@@ -7,6 +7,8 @@
 //
 
 #include "Metadata.h"
+#include "MDLoader.h"
+#include "PEFileReader.h"
 
 namespace silk
 {
@@ -16,16 +18,38 @@ namespace silk
         : row_index_(0)
         {}
 
-        MDRowBase::~MDRowBase()
-        {}
-        
         MDTableBase::MDTableBase()
         : rows_(0)
         , sorted_(false)
+        , file_(nullptr)
+        , data_(nullptr)
+        , row_size_(0)
+        , cached_rows_(nullptr)
         {}
         
         MDTableBase::~MDTableBase()
         {}
+        
+        void MDTableBase::set_data(PEFileReader *file, const char *data, unsigned row_size)
+        {
+            file_ = file;
+            data_ = data;
+            row_size_ = row_size;
+        }
+        
+        MDLoader MDTableBase::GetRowLoader(unsigned index) const
+        {
+            assert (file_ && index <= size());
+            raw_istream is(data_ + (index - 1) * row_size_, row_size_);
+            return MDLoader(file_, is, file_->error_handler());
+        }
+        
+        MDLoader MDTableBase::GetSizingLoader(PEFileReader *file)
+        {
+            // Larger than any row. Zero is a valid index into every heap.
+            static const char zeros[64] = {};
+            return MDLoader(file, raw_istream(zeros, sizeof(zeros)), file->error_handler());
+        }
     }
 }
 
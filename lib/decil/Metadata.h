@@ -9,8 +9,12 @@
 #ifndef SILK_LIB_METADATA_H_
 #define SILK_LIB_METADATA_H_
 
+#include "MDLoader.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
 #include <vector>
-#include <limits>
 #include <cassert>
 #include <cstdint>
 
@@ -24,8 +28,11 @@ namespace silk
             kModuleDefinition = 0x00,
             kTypeReference = 0x01,
             kTypeDefinition = 0x02,
+            kFieldPointer = 0x03,
             kField = 0x04,
+            kMethodPointer = 0x05,
             kMethodDefinition = 0x06,
+            kParameterPointer = 0x07,
             kParameter = 0x08,
             kInterfaceImplementation = 0x09,
             kMemberReference = 0x0A,
@@ -37,8 +44,10 @@ namespace silk
             kFieldLayout = 0x10,
             kStandAloneSignature = 0x11,
             kEventMap = 0x12,
+            kEventPointer = 0x13,
             kEvent = 0x14,
             kPropertyMap = 0x15,
+            kPropertyPointer = 0x16,
             kProperty = 0x17,
             kMethodSemantics = 0x18,
             kMethodImplementation = 0x19,
@@ -46,6 +55,8 @@ namespace silk
             kTypeSpecification = 0x1B,
             kImplementationMap = 0x1C,
             kFieldRVA = 0x1D,
+            kEncLog = 0x1E,
+            kEncMap = 0x1F,
             kAssemblyDefinition = 0x20,
             kAssemblyProcessor = 0x21,
             kAssemblyOperatingSystem = 0x22,
@@ -60,7 +71,28 @@ namespace silk
             kMethodSpecification = 0x2B,
             kGenericParameterConstraint = 0x2C,
             kMetadataTableCount,
-            kInvalidTableReference = 0xffff,
+            // Fits in the table id byte of MDToken
+            kInvalidTableReference = 0xff,
+        };
+        static_assert(kInvalidTableReference == MDToken::kInvalidId, "MDToken does not agree on the invalid table id");
+        
+        // Kinds of coded indices, ECMA-335 Partition II, 24.2.6
+        enum CodedIndexKind
+        {
+            kTypeDefOrRefIndex,
+            kHasConstantIndex,
+            kHasCustomAttributeIndex,
+            kHasFieldMarshallIndex,
+            kHasDeclSecurityIndex,
+            kMemberRefParentIndex,
+            kHasSemanticsIndex,
+            kMethodDefOrRefIndex,
+            kMemberForwardedIndex,
+            kImplementationIndex,
+            kCustomAttributeTypeIndex,
+            kResolutionScopeIndex,
+            kTypeOrMethodDefIndex,
+            kCodedIndexKindCount,
         };
         
         struct MetadataTableHeader
@@ -89,21 +121,34 @@ namespace silk
             { return HeapOffsetSizes & kBlobs32Bit ? 4 : 2; }
         };
         
-        class MDLoader;
+        class PEFileReader;
         
+        //
+        // Rows are plain values without virtual functions. Each row type
+        // provides a Load(MDLoader &) member that lists its columns in
+        // order; MDTable<T> instantiates it for the table.
+        //
         class MDRowBase {
         public:
             unsigned index() const             { return row_index_; }
             void set_row_index(unsigned value) { row_index_ = value; }
             
-            virtual void Load(MDLoader &loader) = 0;
             MDRowBase();
-            virtual ~MDRowBase();
             
         protected:
-            unsigned row_index_;
+            uint32_t row_index_;
         };
         
+        //
+        // The rows of a table are decoded on demand. PEFileReader only binds
+        // each table to its location in the #~ stream; a row is decoded the
+        // first time it is accessed, and iterating over a table decodes all
+        // of its rows.
+        //
+        // Alternatively the table can be bound to rows that have been
+        // decoded before, e.g. the rows stored in a metadata cache. Such
+        // rows are read in place and never decoded again.
+        //
         class MDTableBase {
         public:
             MDTableBase();
@@ -111,57 +156,168 @@ namespace silk
             void set_row(unsigned r) { rows_ = r; }
             unsigned sorted() const  { return sorted_; }
             void set_sorted(bool v)  { sorted_ = v; }
-            bool is_full_id() const  { return size() >= std::numeric_limits<uint16_t>::max(); }
+            unsigned row_size() const { return row_size_; }
+            void set_data(PEFileReader *file, const char *data, unsigned row_size);
+            
+            // The decoded rows, including the unused row 0. The memory has
+            // to outlive the table.
+            const void *cached_rows() const { return cached_rows_; }
+            void set_cached_rows(const void *rows) { cached_rows_ = rows; }
+            
+            // Size of a decoded row in memory
+            virtual unsigned decoded_row_size() const = 0;
+            // Decodes every row and returns them, including row 0
+            virtual const void *LoadRows() const = 0;
+            // Size in bytes of an encoded row, i.e., what Load() consumes
+            virtual unsigned MeasureRowSize(PEFileReader *file) const = 0;
             
-            virtual void Load(MDLoader &loader) = 0;
             virtual ~MDTableBase();
+        protected:
+            MDLoader GetRowLoader(unsigned index) const;
+            // A loader over a row of zeros, which is valid for every table
+            static MDLoader GetSizingLoader(PEFileReader *file);
         private:
             unsigned rows_;
             bool sorted_;
+            PEFileReader *file_;
+            const char *data_;
+            unsigned row_size_;
+            const void *cached_rows_;
         };
         
+        //
+        // The rows are plain values, thus they are copied and cached as
+        // raw memory. The tables are read only to their users, and can be
+        // read by several threads: a row is decoded by the thread that
+        // reads it first, and is published to the others by its flag.
+        //
         template<class EntryType>
         class MDTable : public MDTableBase {
         public:
-            // All indices are started from 1, so here we
-            // reserve another spot here.
-            virtual void Load(MDLoader &loader)
-            {
-                entries_.resize(size() + 1);
-                for (unsigned i = 1; i <= size(); ++i)
-                {
-                    entries_[i].set_row_index(i);
-                    entries_[i].Load(loader);
-                }
-            }
+            MDTable()
+            : all_loaded_(false)
+            {}
             
-            typedef typename std::vector<EntryType>::iterator iterator;
-            typedef typename std::vector<EntryType>::const_iterator const_iterator;
+            typedef const EntryType *iterator;
+            typedef const EntryType *const_iterator;
 
-            iterator begin()
-            { return entries_.size() > 1 ? ++entries_.begin() : entries_.end(); }
-            iterator end()
-            { return entries_.end(); }
-            
             const_iterator begin() const
-            { return entries_.size() > 1 ? ++entries_.begin() : entries_.end(); }
+            { LoadAll(); return size() ? rows() + 1 : nullptr; }
             const_iterator end() const
-            { return entries_.end(); }
+            { LoadAll(); return size() ? rows() + size() + 1 : nullptr; }
             
             const EntryType &get(std::size_t index) const
             {
                 assert (index > 0);
-                return entries_.at(index);
+                return Load(index);
             }
             
-            EntryType &get(std::size_t index)
+            //
+            // Returns the first row whose key column equals the given value,
+            // or 0 when there is none. key_func extracts the column from a
+            // row, e.g. [](const FieldRVA &e) { return e.Field.idx(); }.
+            //
+            // Tables that are marked as sorted in the #~ header are sorted
+            // by their primary key (ECMA-335 Partition II, 22), thus the
+            // lookup is a binary search that decodes O(log n) rows. Other
+            // tables fall back to a linear scan.
+            //
+            template <class KeyFunc>
+            unsigned FindRow(unsigned key, KeyFunc key_func) const
             {
-                assert (index > 0);
-                return entries_.at(index);
+                if (!sorted())
+                {
+                    for (unsigned i = 1; i <= size(); ++i)
+                    {
+                        if (key_func(Load(i)) == key)
+                            return i;
+                    }
+                    return 0;
+                }
+                
+                unsigned lo = 1, hi = size() + 1;
+                while (lo < hi)
+                {
+                    unsigned mid = lo + (hi - lo) / 2;
+                    if (key_func(Load(mid)) < key)
+                        lo = mid + 1;
+                    else
+                        hi = mid;
+                }
+                return lo <= size() && key_func(Load(lo)) == key ? lo : 0;
+            }
+            
+            // Decodes every row of the table
+            void LoadAll() const
+            {
+                if (all_loaded_.load(std::memory_order_acquire) || cached_rows())
+                    return;
+                for (unsigned i = 1; i <= size(); ++i)
+                    Load(i);
+                all_loaded_.store(true, std::memory_order_release);
+            }
+            
+            virtual unsigned decoded_row_size() const override final
+            { return sizeof(EntryType); }
+            
+            virtual const void *LoadRows() const override final
+            {
+                LoadAll();
+                return size() ? rows() : nullptr;
+            }
+            
+            // The columns are only listed once, by EntryType::Load()
+            virtual unsigned MeasureRowSize(PEFileReader *file) const override final
+            {
+                auto loader = GetSizingLoader(file);
+                auto start = loader.stream().pos();
+                EntryType e;
+                e.Load(loader);
+                assert (!loader.stream().fail());
+                return unsigned(loader.stream().pos() - start);
             }
             
         private:
-            std::vector<EntryType> entries_;
+            const EntryType *rows() const
+            {
+                return cached_rows() ? static_cast<const EntryType*>(cached_rows()) : entries_.data();
+            }
+            
+            const EntryType &Load(std::size_t index) const
+            {
+                if (cached_rows())
+                {
+                    assert (index <= size());
+                    return rows()[index];
+                }
+                
+                // All indices are started from 1, so here we
+                // reserve another spot here.
+                std::call_once(entries_allocated_, [this]() {
+                    entries_.resize(size() + 1);
+                    decoded_.reset(new std::atomic<bool>[size() + 1]());
+                });
+                
+                auto &e = entries_.at(index);
+                if (!decoded_[index].load(std::memory_order_acquire))
+                {
+                    std::lock_guard<std::mutex> guard(lock_);
+                    if (!decoded_[index].load(std::memory_order_relaxed))
+                    {
+                        auto loader = GetRowLoader(index);
+                        e.set_row_index(index);
+                        e.Load(loader);
+                        decoded_[index].store(true, std::memory_order_release);
+                    }
+                }
+                return e;
+            }
+            
+            mutable std::vector<EntryType> entries_;
+            mutable std::unique_ptr<std::atomic<bool>[]> decoded_;
+            mutable std::once_flag entries_allocated_;
+            mutable std::mutex lock_;
+            mutable std::atomic<bool> all_loaded_;
         };
     }
 }
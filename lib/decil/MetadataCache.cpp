@@ -0,0 +1,160 @@
+//
+//  MetadataCache.cpp
+//  silk
+//
+//  Created by Haohui Mai on 12/28/12.
+//  Copyright (c) 2012 Haohui Mai. All rights reserved.
+//
+
+#include "MetadataCache.h"
+#include "PEFileReader.h"
+
+#include "silk/Support/ErrorHandler.h"
+#include "silk/Support/MappedFile.h"
+
+#include <llvm/ADT/OwningPtr.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace silk
+{
+    namespace decil
+    {
+        static const char kMagic[8] = { 'S', 'I', 'L', 'K', 'M', 'E', 'T', 'A' };
+        // Bumped whenever the layout of the file or of the rows changes
+        static const uint32_t kVersion = 1;
+        static const size_t kRowAlignment = 16;
+        static const size_t kTablesEnd = sizeof(MetadataCacheHeader)
+            + kMetadataTableCount * sizeof(MetadataCacheTable);
+
+        static const MetadataCacheTable *GetCacheTables(const char *start)
+        {
+            return reinterpret_cast<const MetadataCacheTable*>(start + sizeof(MetadataCacheHeader));
+        }
+
+        std::string GetMetadataCachePath(const std::string &dir, const PEFileReader *file)
+        {
+            auto mvid = file->GetMvid();
+            if (!mvid)
+                return std::string();
+
+            auto &path = file->mapped_file().path();
+            auto slash = path.rfind('/');
+            std::string ret = dir + "/" + (slash == std::string::npos ? path : path.substr(slash + 1)) + "-";
+
+            char hex[3];
+            for (unsigned i = 0; i < 16; ++i)
+            {
+                snprintf(hex, sizeof(hex), "%02x", static_cast<uint8_t>(mvid[i]));
+                ret += hex;
+            }
+            return ret + ".silkmeta";
+        }
+
+        static bool IsValidCache(const MappedFile &cache, const PEFileReader *file)
+        {
+            if (cache.size() < kTablesEnd)
+                return false;
+
+            auto h = reinterpret_cast<const MetadataCacheHeader*>(cache.start());
+            auto &pe = file->mapped_file();
+            if (memcmp(h->Magic, kMagic, sizeof(kMagic))
+                || h->Version != kVersion
+                || h->TableCount != kMetadataTableCount
+                || h->FileSize != pe.size()
+                || h->FileModificationTime != pe.mtime()
+                || memcmp(h->Mvid, file->GetMvid(), sizeof(h->Mvid)))
+                return false;
+
+            auto tables = GetCacheTables(cache.start());
+            for (unsigned i = 0; i < kMetadataTableCount; ++i)
+            {
+                auto tbl = file->table(i);
+                if (!tbl || !tbl->size())
+                    continue;
+
+                auto &t = tables[i];
+                uint64_t end = t.Offset + uint64_t(t.Rows + 1) * t.RowSize;
+                if (t.Rows != tbl->size()
+                    || t.RowSize != tbl->decoded_row_size()
+                    || t.Offset < kTablesEnd
+                    || t.Offset % kRowAlignment
+                    || end > cache.size())
+                    return false;
+            }
+            return true;
+        }
+
+        bool LoadMetadataCache(const std::string &dir, PEFileReader *file)
+        {
+            auto path = GetMetadataCachePath(dir, file);
+            if (path.empty())
+                return false;
+
+            // A missing cache is not an error
+            ErrorHandler eh(true);
+            llvm::OwningPtr<MappedFile> cache(MappedFile::Open(path, eh));
+            if (!cache || !IsValidCache(*cache, file))
+                return false;
+
+            auto tables = GetCacheTables(cache->start());
+            for (unsigned i = 0; i < kMetadataTableCount; ++i)
+            {
+                auto tbl = file->table(i);
+                if (tbl && tbl->size())
+                    tbl->set_cached_rows(cache->start() + tables[i].Offset);
+            }
+            file->set_cache_file(cache.take());
+            return true;
+        }
+
+        bool StoreMetadataCache(const std::string &dir, const PEFileReader *file, ErrorHandler &eh)
+        {
+            auto path = GetMetadataCachePath(dir, file);
+            if (path.empty())
+                return false;
+
+            std::vector<char> data(kTablesEnd);
+
+            MetadataCacheTable tables[kMetadataTableCount];
+            memset(tables, 0, sizeof(tables));
+            for (unsigned i = 0; i < kMetadataTableCount; ++i)
+            {
+                auto tbl = file->table(i);
+                if (!tbl || !tbl->size())
+                    continue;
+
+                auto rows = static_cast<const char*>(tbl->LoadRows());
+                auto &t = tables[i];
+                t.Rows = tbl->size();
+                t.RowSize = tbl->decoded_row_size();
+                t.Offset = (data.size() + kRowAlignment - 1) & ~(kRowAlignment - 1);
+                data.resize(t.Offset);
+                data.insert(data.end(), rows, rows + (t.Rows + 1) * t.RowSize);
+            }
+
+            MetadataCacheHeader h;
+            memset(&h, 0, sizeof(h));
+            memcpy(h.Magic, kMagic, sizeof(kMagic));
+            h.Version = kVersion;
+            h.TableCount = kMetadataTableCount;
+            h.FileSize = file->mapped_file().size();
+            h.FileModificationTime = file->mapped_file().mtime();
+            memcpy(h.Mvid, file->GetMvid(), sizeof(h.Mvid));
+
+            memcpy(data.data(), &h, sizeof(h));
+            memcpy(data.data() + sizeof(h), tables, sizeof(tables));
+
+            // Other compilers might map the old file concurrently
+            if (!WriteFileAtomically(path, data.data(), data.size()))
+            {
+                eh.Warn("Cannot write metadata cache `%s': %s.", path.c_str(), strerror(errno));
+                return false;
+            }
+            return true;
+        }
+    }
+}
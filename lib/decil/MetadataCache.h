@@ -0,0 +1,71 @@
+//
+//  MetadataCache.h
+//  silk
+//
+//  Created by Haohui Mai on 12/28/12.
+//  Copyright (c) 2012 Haohui Mai. All rights reserved.
+//
+
+#ifndef SILK_LIB_DECIL_METADATA_CACHE_H_
+#define SILK_LIB_DECIL_METADATA_CACHE_H_
+
+#include <string>
+#include <cstdint>
+
+namespace silk
+{
+    class ErrorHandler;
+    namespace decil
+    {
+        class PEFileReader;
+
+        //
+        // A .silkmeta file holds the decoded metadata tables of an
+        // assembly. The rows are plain values that only refer to other rows
+        // and to the heaps by index, thus the file is mapped and the tables
+        // read their rows in place without decoding them.
+        //
+        // The heaps and the IL are still read from the assembly itself.
+        //
+        // The file is named after the assembly and its module version id
+        // (MVID). It also records the size and the modification time of the
+        // assembly, and the size of each decoded row. A file that does not
+        // match any of them is stale and is written again.
+        //
+        //   MetadataCacheHeader
+        //   MetadataCacheTable[kMetadataTableCount]
+        //   rows of each table, including row 0, 16-byte aligned
+        //
+        struct MetadataCacheHeader
+        {
+            char Magic[8];
+            uint32_t Version;
+            uint32_t TableCount;
+            uint64_t FileSize;
+            int64_t FileModificationTime;
+            uint8_t Mvid[16];
+        };
+
+        struct MetadataCacheTable
+        {
+            uint32_t Rows;
+            uint32_t RowSize;
+            // Zero for the tables that are not decoded
+            uint64_t Offset;
+        };
+
+        // Path of the cache of the assembly in dir
+        std::string GetMetadataCachePath(const std::string &dir, const PEFileReader *file);
+
+        // Binds the tables of file to its cache in dir. Returns false when
+        // there is no valid cache.
+        bool LoadMetadataCache(const std::string &dir, PEFileReader *file);
+
+        // Decodes all tables of file and writes them to its cache in dir.
+        // The file is replaced atomically, thus concurrent compilers never
+        // read a partial cache.
+        bool StoreMetadataCache(const std::string &dir, const PEFileReader *file, ErrorHandler &eh);
+    }
+}
+
+#endif
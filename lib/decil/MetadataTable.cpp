@@ -13,116 +13,144 @@ namespace silk
 {
     namespace decil
     {
-        const int ResolutionScopeTrait::tags[] =
-        {
-            kModuleDefinition,
-            kModuleReference,
-            kAssemblyReference,
-            kTypeReference,
-        };
-        
-        const int TypeDefOrRefTrait::tags[] =
-        {
-            kTypeDefinition,
-            kTypeReference,
-            kTypeSpecification,
-        };
-        
-        const int HasConstantTrait::tags[] =
-        {
-            kField,
-            kParameter,
-            kProperty,
-        };
-        
-        const int HasCustomAttributeTrait::tags[] =
-        {
-            kMethodDefinition,
-            kField,
-            kTypeReference,
-            kTypeDefinition,
-            kParameter,
-            kInterfaceImplementation,
-            kMemberReference,
-            kModuleDefinition,
-            /* kPermission */
-            kInvalidTableReference,
-            kProperty,
-            kEvent,
-            kStandAloneSignature,
-            kModuleReference,
-            kTypeSpecification,
-            kAssemblyDefinition,
-            kAssemblyReference,
-            kFile,
-            kExportedType,
-            kManifestResource,
-            kGenericParameter,
-            kGenericParameterConstraint,
-            kMethodSpecification,
-        };
-        
-        const int HasFieldMarshallTrait::tags[] =
-        {
-            kField,
-            kParameter,
-        };
-        
-        const int HasDeclSecurityTrait::tags[] =
-        {
-            kTypeDefinition,
-            kMethodDefinition,
-            kAssemblyDefinition,
-        };
-        
-        const int MemberRefParentTrait::tags[] =
-        {
-            kTypeDefinition,
-            kTypeReference,
-            kModuleReference,
-            kMethodDefinition,
-            kTypeSpecification,
-        };
-        
-        const int HasSemanticsTrait::tags[] =
-        {
-            kEvent,
-            kProperty,
-        };
-        
-        const int MethodDefOrRefTrait::tags[] =
-        {
-            kMethodDefinition,
-            kMemberReference,
-        };
-        
-        const int MemberForwardedTrait::tags[] =
-        {
-            kField,
-            kMethodDefinition,
-        };
-        
-        const int ImplementationTrait::tags[] =
-        {
-            kFile,
-            kAssemblyReference,
-            kExportedType,
-        };
-        
-        const int CustomAttributeTypeTrait::tags[] =
-        {
-            kInvalidTableReference,
-            kInvalidTableReference,
-            kMethodDefinition,
-            kMemberReference,
-            kInvalidTableReference,
-        };
+        // Definitions of the tag tables declared in MetadataTable.h
+        constexpr int ResolutionScopeTrait::tags[];
+        constexpr int TypeDefOrRefTrait::tags[];
+        constexpr int HasConstantTrait::tags[];
+        constexpr int HasCustomAttributeTrait::tags[];
+        constexpr int HasFieldMarshallTrait::tags[];
+        constexpr int HasDeclSecurityTrait::tags[];
+        constexpr int MemberRefParentTrait::tags[];
+        constexpr int HasSemanticsTrait::tags[];
+        constexpr int MethodDefOrRefTrait::tags[];
+        constexpr int MemberForwardedTrait::tags[];
+        constexpr int ImplementationTrait::tags[];
+        constexpr int CustomAttributeTypeTrait::tags[];
+        constexpr int TypeOrMethodDefTrait::tags[];
+        
+        namespace
+        {
+            enum ColumnKind
+            {
+                kEndOfRow,
+                kFixed,
+                kStringIndex,
+                kGUIDIndex,
+                kBlobIndex,
+                kTableIndex,
+                kCodedIndex,
+            };
+            
+            struct Column
+            {
+                ColumnKind kind;
+                // Size of a fixed column, the id of the referenced table,
+                // or the kind of the coded index
+                unsigned arg;
+            };
+            
+#define FIXED(n)        { kFixed, n }
+#define STRING          { kStringIndex, 0 }
+#define GUID            { kGUIDIndex, 0 }
+#define BLOB            { kBlobIndex, 0 }
+#define INDEX(t)        { kTableIndex, t }
+#define CODED(trait)    { kCodedIndex, trait::kind }
+            
+            //
+            // ECMA-335 Partition II, 22. At most nine columns per table.
+            // The tables that the reader decodes are left empty, their
+            // columns are the ones that the Load() of their rows reads.
+            //
+            const Column kSchema[kMetadataTableCount][10] =
+            {
+                /* Module */ {},
+                /* TypeRef */ {},
+                /* TypeDef */ {},
+                /* FieldPtr */ { INDEX(kField) },
+                /* Field */ {},
+                /* MethodPtr */ { INDEX(kMethodDefinition) },
+                /* MethodDef */ {},
+                /* ParamPtr */ { INDEX(kParameter) },
+                /* Param */ {},
+                /* InterfaceImpl */ {},
+                /* MemberRef */ {},
+                /* Constant */ {},
+                /* CustomAttribute */ {},
+                /* FieldMarshal */ { CODED(HasFieldMarshallTrait), BLOB },
+                /* DeclSecurity */ {},
+                /* ClassLayout */ {},
+                /* FieldLayout */ { FIXED(4), INDEX(kField) },
+                /* StandAloneSig */ {},
+                /* EventMap */ { INDEX(kTypeDefinition), INDEX(kEvent) },
+                /* EventPtr */ { INDEX(kEvent) },
+                /* Event */ { FIXED(2), STRING, CODED(TypeDefOrRefTrait) },
+                /* PropertyMap */ {},
+                /* PropertyPtr */ { INDEX(kProperty) },
+                /* Property */ {},
+                /* MethodSemantics */ {},
+                /* MethodImpl */ {},
+                /* ModuleRef */ {},
+                /* TypeSpec */ {},
+                /* ImplMap */ {},
+                /* FieldRVA */ {},
+                /* EncLog */ { FIXED(4), FIXED(4) },
+                /* EncMap */ { FIXED(4) },
+                /* Assembly */ {},
+                /* AssemblyProcessor */ { FIXED(4) },
+                /* AssemblyOS */ { FIXED(4), FIXED(4), FIXED(4) },
+                /* AssemblyRef */ {},
+                /* AssemblyRefProcessor */ { FIXED(4), INDEX(kAssemblyReference) },
+                /* AssemblyRefOS */ { FIXED(4), FIXED(4), FIXED(4), INDEX(kAssemblyReference) },
+                /* File */ { FIXED(4), STRING, BLOB },
+                /* ExportedType */ {},
+                /* ManifestResource */ { FIXED(4), FIXED(4), STRING, CODED(ImplementationTrait) },
+                /* NestedClass */ {},
+                /* GenericParam */ {},
+                /* MethodSpec */ { CODED(MethodDefOrRefTrait), BLOB },
+                /* GenericParamConstraint */ { INDEX(kGenericParameter), CODED(TypeDefOrRefTrait) },
+            };
+            
+#undef FIXED
+#undef STRING
+#undef GUID
+#undef BLOB
+#undef INDEX
+#undef CODED
+        }
         
-        const int TypeOrMethodDefTrait::tags[] =
-        {
-            kTypeDefinition,
-            kMethodDefinition,
-        };
+        unsigned MetadataRowSize(const PEFileReader *file, unsigned table_id)
+        {
+            assert (table_id < kMetadataTableCount && kSchema[table_id][0].kind != kEndOfRow);
+            const auto &h = file->mdt_header();
+            unsigned size = 0;
+            for (auto c = kSchema[table_id]; c->kind != kEndOfRow; ++c)
+            {
+                switch (c->kind)
+                {
+                    case kFixed:
+                        size += c->arg;
+                        break;
+                    case kStringIndex:
+                        size += h.StringIndexSize();
+                        break;
+                    case kGUIDIndex:
+                        size += h.GUIDIndexSize();
+                        break;
+                    case kBlobIndex:
+                        size += h.BlobIndexSize();
+                        break;
+                    case kTableIndex:
+                        size += file->simple_index_size(c->arg);
+                        break;
+                    case kCodedIndex:
+                        size += file->coded_index_size(c->arg);
+                        break;
+                    case kEndOfRow:
+                        break;
+                }
+            }
+            return size;
+        }
         
         void AssemblyDefinition::Load(MDLoader &loader)
         {
@@ -216,8 +244,7 @@ namespace silk
         
         void ModuleDefinition::Load(MDLoader &loader)
         {
-            loader.stream().skip(2);
-            loader.Load(&Name).Load(&Mvid).Load(&EncId).Load(&EncBaseId);
+            loader.Load(&Generation).Load(&Name).Load(&Mvid).Load(&EncId).Load(&EncBaseId);
         }
         
         void ModuleReference::Load(MDLoader &loader)
@@ -225,6 +252,12 @@ namespace silk
             loader.Load(&Name);
         }
         
+        void ExportedType::Load(MDLoader &loader)
+        {
+            loader.stream() >> Flags >> TypeDefId;
+            loader.Load(&TypeName).Load(&TypeNamespace).Load(&Implementation);
+        }
+        
         void NestedClass::Load(MDLoader &loader)
         {
             loader.Load(&NestedClass).Load(&EnclosingClass);
@@ -54,95 +54,197 @@ namespace silk
         class GenericParameter;
         class MethodSpecification;
         class GenericParameterConstraint;
+        class PEFileReader;
+        
+        // Size in bytes of a row of a table that the reader skips. The rows
+        // of the decoded tables are measured by MDTable::MeasureRowSize().
+        unsigned MetadataRowSize(const PEFileReader *file, unsigned table_id);
         
-                
         struct TypeDefOrRefTrait
         {
-            static const int tags[];
+            static const CodedIndexKind kind = kTypeDefOrRefIndex;
+            static constexpr int tags[] =
+            {
+                kTypeDefinition,
+                kTypeReference,
+                kTypeSpecification,
+            };
             static const unsigned tag_length = 3;
             static const unsigned tag_bits = 2;
         };
         
         struct HasConstantTrait
         {
-            static const int tags[];
+            static const CodedIndexKind kind = kHasConstantIndex;
+            static constexpr int tags[] =
+            {
+                kField,
+                kParameter,
+                kProperty,
+            };
             static const unsigned tag_length = 3;
             static const unsigned tag_bits = 2;
         };
         
         struct HasCustomAttributeTrait
         {
-            static const int tags[];
+            static const CodedIndexKind kind = kHasCustomAttributeIndex;
+            static constexpr int tags[] =
+            {
+                kMethodDefinition,
+                kField,
+                kTypeReference,
+                kTypeDefinition,
+                kParameter,
+                kInterfaceImplementation,
+                kMemberReference,
+                kModuleDefinition,
+                /* Permission */
+                kDeclSecurity,
+                kProperty,
+                kEvent,
+                kStandAloneSignature,
+                kModuleReference,
+                kTypeSpecification,
+                kAssemblyDefinition,
+                kAssemblyReference,
+                kFile,
+                kExportedType,
+                kManifestResource,
+                kGenericParameter,
+                kGenericParameterConstraint,
+                kMethodSpecification,
+            };
             static const unsigned tag_length = 22;
             static const unsigned tag_bits = 5;
         };
         
         struct HasFieldMarshallTrait
         {
-            static const int tags[];
+            static const CodedIndexKind kind = kHasFieldMarshallIndex;
+            static constexpr int tags[] =
+            {
+                kField,
+                kParameter,
+            };
             static const unsigned tag_length = 2;
             static const unsigned tag_bits = 1;
         };
         
         struct HasDeclSecurityTrait
         {
-            static const int tags[];
+            static const CodedIndexKind kind = kHasDeclSecurityIndex;
+            static constexpr int tags[] =
+            {
+                kTypeDefinition,
+                kMethodDefinition,
+                kAssemblyDefinition,
+            };
             static const unsigned tag_length = 3;
             static const unsigned tag_bits = 2;
         };
         
         struct MemberRefParentTrait
         {
-            static const int tags[];
+            static const CodedIndexKind kind = kMemberRefParentIndex;
+            static constexpr int tags[] =
+            {
+                kTypeDefinition,
+                kTypeReference,
+                kModuleReference,
+                kMethodDefinition,
+                kTypeSpecification,
+            };
             static const unsigned tag_length = 5;
             static const unsigned tag_bits = 3;
         };
         
         struct HasSemanticsTrait
         {
-            static const int tags[];
+            static const CodedIndexKind kind = kHasSemanticsIndex;
+            static constexpr int tags[] =
+            {
+                kEvent,
+                kProperty,
+            };
             static const unsigned tag_length = 2;
             static const unsigned tag_bits = 1;
         };
         
         struct MethodDefOrRefTrait
         {
-            static const int tags[];
+            static const CodedIndexKind kind = kMethodDefOrRefIndex;
+            static constexpr int tags[] =
+            {
+                kMethodDefinition,
+                kMemberReference,
+            };
             static const unsigned tag_length = 2;
             static const unsigned tag_bits = 1;
         };
         
         struct MemberForwardedTrait
         {
-            static const int tags[];
+            static const CodedIndexKind kind = kMemberForwardedIndex;
+            static constexpr int tags[] =
+            {
+                kField,
+                kMethodDefinition,
+            };
             static const unsigned tag_length = 2;
             static const unsigned tag_bits = 1;
         };
         
         struct ImplementationTrait
         {
-            static const int tags[];
+            static const CodedIndexKind kind = kImplementationIndex;
+            static constexpr int tags[] =
+            {
+                kFile,
+                kAssemblyReference,
+                kExportedType,
+            };
             static const unsigned tag_length = 3;
             static const unsigned tag_bits = 2;
         };
         
         struct CustomAttributeTypeTrait
         {
-            static const int tags[];
+            static const CodedIndexKind kind = kCustomAttributeTypeIndex;
+            static constexpr int tags[] =
+            {
+                kInvalidTableReference,
+                kInvalidTableReference,
+                kMethodDefinition,
+                kMemberReference,
+                kInvalidTableReference,
+            };
             static const unsigned tag_length = 5;
             static const unsigned tag_bits = 3;
         };
         
         struct ResolutionScopeTrait
         {
-            static const int tags[];
+            static const CodedIndexKind kind = kResolutionScopeIndex;
+            static constexpr int tags[] =
+            {
+                kModuleDefinition,
+                kModuleReference,
+                kAssemblyReference,
+                kTypeReference,
+            };
             static const unsigned tag_length = 4;
             static const unsigned tag_bits = 2;
         };
         
         struct TypeOrMethodDefTrait
         {
-            static const int tags[];
+            static const CodedIndexKind kind = kTypeOrMethodDefIndex;
+            static constexpr int tags[] =
+            {
+                kTypeDefinition,
+                kMethodDefinition,
+            };
             static const unsigned tag_length = 2;
             static const unsigned tag_bits = 1;
         };
@@ -151,7 +253,8 @@ namespace silk
         {
         public:
             static unsigned id() { return kModuleDefinition; }
-            virtual void Load(MDLoader &loader);
+            void Load(MDLoader &loader);
+            uint16_t Generation;
             MDString Name;
             MDGUID Mvid;
             MDGUID EncId;
@@ -162,7 +265,7 @@ namespace silk
         {
         public:
             static unsigned id() { return kTypeReference; }
-            virtual void Load(MDLoader &loader);
+            void Load(MDLoader &loader);
             MDCodedToken<ResolutionScopeTrait> ResolutionScope;
             MDString TypeName;
             MDString TypeNamespace;
@@ -212,7 +315,7 @@ namespace silk
             };
             
             static unsigned id() { return kTypeDefinition; }
-            virtual void Load(MDLoader &loader);
+            void Load(MDLoader &loader);
             bool is_nested() const { return Flags & kNestedMask; }
             
             uint32_t Flags;
@@ -249,7 +352,7 @@ namespace silk
             };
             
             static unsigned id() { return kField; }
-            virtual void Load(MDLoader &loader);
+            void Load(MDLoader &loader);
             uint16_t Flags;
             MDString Name;
             MDBlob Signature;
@@ -287,7 +390,7 @@ namespace silk
             };
             
             static unsigned id() { return kMethodDefinition; }
-            virtual void Load(MDLoader &loader);
+            void Load(MDLoader &loader);
             uint32_t RVA;
             uint16_t ImplFlags;
             uint16_t Flags;
@@ -300,7 +403,7 @@ namespace silk
         {
         public:
             static unsigned id() { return kParameter; }
-            virtual void Load(MDLoader &loader);
+            void Load(MDLoader &loader);
             uint16_t Flags;
             uint16_t Sequence;
             MDString Name;
@@ -310,7 +413,7 @@ namespace silk
         {
         public:
             static unsigned id() { return kInterfaceImplementation; }
-            virtual void Load(MDLoader &loader);
+            void Load(MDLoader &loader);
             MDSimpleToken<TypeDefinition> Class;
             MDCodedToken<TypeDefOrRefTrait> Interface;
         };
@@ -319,7 +422,7 @@ namespace silk
         {
         public:
             static unsigned id() { return kMemberReference; }
-            virtual void Load(MDLoader &loader);
+            void Load(MDLoader &loader);
             MDCodedToken<MemberRefParentTrait> Class;
             MDString Name;
             MDBlob Signature;
@@ -329,7 +432,7 @@ namespace silk
         {
         public:
             static unsigned id() { return kConstant; }
-            virtual void Load(MDLoader &loader);
+            void Load(MDLoader &loader);
             uint16_t Type;
             MDCodedToken<HasConstantTrait> Parent;
             MDBlob Value;
@@ -339,7 +442,7 @@ namespace silk
         {
         public:
             static unsigned id() { return kCustomAttribute; }
-            virtual void Load(MDLoader &loader);
+            void Load(MDLoader &loader);
             MDCodedToken<HasCustomAttributeTrait> Parent;
             MDCodedToken<CustomAttributeTypeTrait> Type;
             MDBlob Value;
@@ -349,7 +452,7 @@ namespace silk
         {
         public:
             static unsigned id() { return kDeclSecurity; }
-            virtual void Load(MDLoader &loader);
+            void Load(MDLoader &loader);
             uint16_t Action;
             MDCodedToken<HasDeclSecurityTrait> Parent;
             MDBlob PermissionSet;
@@ -359,7 +462,7 @@ namespace silk
         {
         public:
             static unsigned id() { return kClassLayout; }
-            virtual void Load(MDLoader &loader);
+            void Load(MDLoader &loader);
             uint16_t PackingSize;
             uint32_t ClassSize;
             MDSimpleToken<TypeDefinition> Parent;
@@ -369,7 +472,7 @@ namespace silk
         {
         public:
             static unsigned id() { return kStandAloneSignature; }
-            virtual void Load(MDLoader &loader);
+            void Load(MDLoader &loader);
             MDBlob Signature;
         };
         
@@ -377,7 +480,7 @@ namespace silk
         {
         public:
             static unsigned id() { return kPropertyMap; }
-            virtual void Load(MDLoader &loader);
+            void Load(MDLoader &loader);
             MDSimpleToken<TypeDefinition> Parent;
             MDSimpleToken<PropertyDefinition> PropertyList;
         };
@@ -386,7 +489,7 @@ namespace silk
         {
         public:
             static unsigned id() { return kProperty; }
-            virtual void Load(MDLoader &loader);
+            void Load(MDLoader &loader);
             uint16_t Flags;
             MDString Name;
             MDBlob Type;
@@ -396,7 +499,7 @@ namespace silk
         {
         public:
             static unsigned id() { return kMethodSemantics; }
-            virtual void Load(MDLoader &loader);
+            void Load(MDLoader &loader);
             uint16_t Semantics;
             MDSimpleToken<MethodDef> Method;
             MDCodedToken<HasSemanticsTrait> Association;
@@ -406,7 +509,7 @@ namespace silk
         {
         public:
             static unsigned id() { return kMethodImplementation; }
-            virtual void Load(MDLoader &loader);
+            void Load(MDLoader &loader);
             MDSimpleToken<TypeDefinition> Class;
             MDCodedToken<MethodDefOrRefTrait> MethodBody;
             MDCodedToken<MethodDefOrRefTrait> MethodDeclaration;
@@ -416,7 +519,7 @@ namespace silk
         {
         public:
             static unsigned id() { return kModuleReference; }
-            virtual void Load(MDLoader &loader);
+            void Load(MDLoader &loader);
             MDString Name;
         };
         
@@ -425,7 +528,7 @@ namespace silk
         {
         public:
             static unsigned id() { return kTypeSpecification; }
-            virtual void Load(MDLoader &loader);
+            void Load(MDLoader &loader);
             MDBlob Signature;
         };
         
@@ -433,7 +536,7 @@ namespace silk
         {
         public:
             static unsigned id() { return kImplementationMap; }
-            virtual void Load(MDLoader &loader);
+            void Load(MDLoader &loader);
             uint16_t MappingFlags;
             MDCodedToken<MemberForwardedTrait> MemberForwarded;
             MDString ImportName;
@@ -444,16 +547,16 @@ namespace silk
         {
         public:
             static unsigned id() { return kFieldRVA; }
-            virtual void Load(MDLoader &loader);
+            void Load(MDLoader &loader);
             uint32_t RVA;
-            MDSimpleToken<TypeDefinition> Field;
+            MDSimpleToken<FieldDef> Field;
         };
         
         class AssemblyDefinition : public MDRowBase
         {
         public:
             static unsigned id() { return kAssemblyDefinition; }
-            virtual void Load(MDLoader &loader);
+            void Load(MDLoader &loader);
             uint32_t HashAlgId;
             uint16_t MajorVersion;
             uint16_t MinorVersion;
@@ -469,7 +572,7 @@ namespace silk
         {
         public:
             static unsigned id() { return kAssemblyReference; }
-            virtual void Load(MDLoader &loader);
+            void Load(MDLoader &loader);
             uint16_t MajorVersion;
             uint16_t MinorVersion;
             uint16_t BuildNumber;
@@ -481,11 +584,26 @@ namespace silk
             MDBlob HashValue;
         };
         
+        class ExportedType : public MDRowBase
+        {
+        public:
+            static unsigned id() { return kExportedType; }
+            void Load(MDLoader &loader);
+            // A nested exported type refers to its enclosing exported type
+            bool is_nested() const { return Implementation.id() == kExportedType; }
+            
+            uint32_t Flags;
+            uint32_t TypeDefId;
+            MDString TypeName;
+            MDString TypeNamespace;
+            MDCodedToken<ImplementationTrait> Implementation;
+        };
+        
         class NestedClass : public MDRowBase
         {
         public:
             static unsigned id() { return kNestedClass; }
-            virtual void Load(MDLoader &loader);
+            void Load(MDLoader &loader);
             MDSimpleToken<TypeDefinition> NestedClass;
             MDSimpleToken<TypeDefinition> EnclosingClass;
         };
@@ -494,7 +612,7 @@ namespace silk
         {
         public:
             static unsigned id() { return kGenericParameter; }
-            virtual void Load(MDLoader &loader);
+            void Load(MDLoader &loader);
             uint16_t Number;
             uint16_t Flags;
             MDCodedToken<TypeOrMethodDefTrait> Owner;
@@ -8,34 +8,15 @@
 
 #include "silk/decil/ObjectModel.h"
 
+#include <algorithm>
 #include <cassert>
 
 namespace silk
 {
     namespace decil
     {
-        IOperation::~IOperation()
-        {}
-        
-        ILOperand::ILOperand()
-        : type_(kNull)
-        {}
-     
-        int64_t ILOperand::GetInt() const
-        { assert (type_ == kInt); return int64_; }
-        float ILOperand::GetFloat() const
-        { assert (type_ == kFloat); return float4_; }
-        double ILOperand::GetDouble() const
-        { assert (type_ == kDouble); return double8_; }
-        IMetadata *ILOperand::GetMetadata() const
-        { assert (type_ == kMetadata); return md_; }
-        const std::u16string &ILOperand::GetString() const
-        { assert (type_ == kString); return str_; }
-        const std::vector<int> &ILOperand::GetIntArray() const
-        { assert (type_ == kIntArray); return int_arr_; }
-        
         void ILOperand::Clear()
-        { type_ = kNull; }
+        { type_ = kNull; int64_ = 0; }
         void ILOperand::SetInt(int64_t v)
         { type_ = kInt; int64_ = v; }
         void ILOperand::SetFloat(float v)
@@ -44,9 +25,37 @@ namespace silk
         { type_ = kDouble; double8_ = v; }
         void ILOperand::SetMetadata(IMetadata *v)
         { type_ = kMetadata; md_ = v; }
-        void ILOperand::SetString(const std::u16string &v)
-        { type_ = kString; str_ = v; }
-        void ILOperand::SetIntArray(const std::vector<int> &v)
-        { type_ = kIntArray; int_arr_ = v; }
+        void ILOperand::SetString(unsigned index)
+        { type_ = kString; range_.index = index; range_.count = 1; }
+        void ILOperand::SetIntArray(unsigned index, unsigned count)
+        { type_ = kIntArray; range_.index = index; range_.count = count; }
+        
+        unsigned ILBody::AddString(const std::u16string &str)
+        {
+            strings_.push_back(str);
+            return strings_.size() - 1;
+        }
+        
+        unsigned ILBody::AddIntArray(const std::vector<int> &v)
+        {
+            unsigned index = targets_.size();
+            targets_.insert(targets_.end(), v.begin(), v.end());
+            return index;
+        }
+        
+        void ILBody::AddMemoryParam(IParameterDefinition *param)
+        {
+            if (std::find(memory_params_.begin(), memory_params_.end(), param) == memory_params_.end())
+                memory_params_.push_back(param);
+        }
+        
+        void ILBody::Shrink()
+        {
+            instructions_.shrink_to_fit();
+            strings_.shrink_to_fit();
+            targets_.shrink_to_fit();
+            std::sort(block_starts_.begin(), block_starts_.end());
+            block_starts_.erase(std::unique(block_starts_.begin(), block_starts_.end()), block_starts_.end());
+        }
     }
 }
@@ -10,6 +10,11 @@
 #include "MDLoader.h"
 #include "MetadataTable.h"
 
+#include "silk/Support/Util.h"
+
+#include <algorithm>
+#include <cstring>
+
 namespace silk
 {
     using namespace llvm;
@@ -30,10 +35,14 @@ namespace silk
             return 1ULL << index;
         }
         
-        PEFileReader::PEFileReader(IHost *host, OwningPtr<MemoryBuffer> &file)
+        PEFileReader::PEFileReader(IHost *host, MappedFile *file, ErrorHandler *eh)
         : host_(host)
-        , file_(file.take())
+        , error_handler_(eh ? eh : &host->error_handler())
+        , file_(file)
         , state_(ReaderState::kInitialized)
+        , row_counts_()
+        , simple_index_sizes_()
+        , coded_index_sizes_()
         {
             if (ReadPEFileLevelData() || ReadCORModuleLevelData() || ReadMetadataLevelData())
                 return;
@@ -41,8 +50,8 @@ namespace silk
         
         int PEFileReader::ReadPEFileLevelData()
         {
-            raw_istream is(file_.get());
-            ErrorHandler &eh = host_->error_handler();
+            raw_istream is(file_->start(), file_->size());
+            ErrorHandler &eh = error_handler();
             
             ReadPEHeader(is, eh);
             if (eh.has_error())
@@ -65,7 +74,7 @@ namespace silk
         int PEFileReader::ReadCORModuleLevelData()
         {
             const PEDirectoryEntry &clr_header_entry = optional_pe_directory_entries_[kCLRRuntimeHeader];
-            ErrorHandler &eh = host_->error_handler();
+            ErrorHandler &eh = error_handler();
             
             raw_istream hs = DirectoryToIStream(clr_header_entry, eh);
             if (eh.has_error())
@@ -81,6 +90,7 @@ namespace silk
             if (eh.has_error())
                 return -1;
             
+            AdviseMetadataStreams();
             state_ = ReaderState::kCORModule;
             return 0;
         }
@@ -89,34 +99,55 @@ namespace silk
         {
             InitializeMetadataTables();
             raw_istream & is = md_streams_[kCompressedMetadataTableStream];
-            ErrorHandler &eh = host_->error_handler();
+            ErrorHandler &eh = error_handler();
             
             is.read(mdt_header_);
             
-            for (unsigned i = 0; i < kMetadataTableCount; ++i) {
+            for (unsigned i = 0; i < 64; ++i) {
                 if (!(GetBitMask(i) & mdt_header_.PresentTables))
                     continue;
                 
-                if (md_tables_.count(i) == 0) {
-                    eh.Error("Unimplemented CIL table %d", i);
-                    continue;
+                if (i >= kMetadataTableCount) {
+                    eh.Error("Unknown CIL table %d", i);
+                    return -1;
                 }
                 
-                uint32_t row_count;
-                is >> row_count;
-                md_tables_[i]->set_row(row_count);
-                md_tables_[i]->set_sorted(GetBitMask(i) & mdt_header_.SortedTables);
+                is >> row_counts_[i];
             }
             
-            MDLoader loader(this, is, eh);
-            for (auto &it : md_tables_)
+            InitializeIndexSizes();
+            
+            //
+            // The row sizes only depend on the heap flags and the row counts,
+            // so the location of every table is known without decoding any of
+            // them. The rows are decoded on demand by MDTable<T>.
+            //
+            const char *p = is.pos();
+            for (unsigned i = 0; i < kMetadataTableCount; ++i)
             {
-                it.second->Load(loader);
+                if (!row_counts_[i])
+                    continue;
+                
+                auto tbl = table(i);
+                unsigned row_size = tbl ? tbl->MeasureRowSize(this) : MetadataRowSize(this, i);
+                // The row counts come from the file, thus the size must not
+                // wrap around nor leave the stream
+                uint64_t size = uint64_t(row_size) * row_counts_[i];
+                if (p > is.end() || size > uint64_t(is.end() - p))
+                {
+                    eh.Error("Metadata table stream is truncated.");
+                    return -1;
+                }
+                
+                if (tbl)
+                {
+                    tbl->set_row(row_counts_[i]);
+                    tbl->set_sorted(GetBitMask(i) & mdt_header_.SortedTables);
+                    tbl->set_data(this, p, row_size);
+                }
+                p += size;
             }
             
-            if (eh.has_error())
-                return -1;
-            
             state_ = ReaderState::kMetadata;
             return 0;
         }
@@ -278,6 +309,31 @@ namespace silk
             }
         }
         
+        void PEFileReader::AdviseMetadataStreams() const
+        {
+            // The tables are decoded front to back, while the heaps are
+            // indexed from all over the tables and the IL.
+            static const struct
+            {
+                unsigned idx;
+                MappedFile::Advice advice;
+            } hints[] = {
+                { kCompressedMetadataTableStream, MappedFile::Advice::kSequential },
+                { kUncompressedMetadataTableStream, MappedFile::Advice::kSequential },
+                { kStringStream, MappedFile::Advice::kRandom },
+                { kBlobStream, MappedFile::Advice::kRandom },
+                { kGUIDStream, MappedFile::Advice::kRandom },
+                { kUserStringStream, MappedFile::Advice::kRandom },
+            };
+            
+            for (auto &h : hints)
+            {
+                auto &s = md_streams_[h.idx];
+                if (s.size())
+                    file_->Advise(s.start(), s.size(), h.advice);
+            }
+        }
+        
         raw_istream PEFileReader::DirectoryToIStream(const PEDirectoryEntry &e, ErrorHandler &eh) const
         {
             for (auto &it : pe_section_headers_)
@@ -287,7 +343,7 @@ namespace silk
                 {
                     // FIXME: Padding might not be zeroed
                     int offset = e.RelativeVirtualAddress - it.VirtualAddress;
-                    return raw_istream(file_->getBufferStart() + it.PointerToRawData + offset, e.Size);
+                    return raw_istream(file_->start() + it.PointerToRawData + offset, e.Size);
                 }
             }
             
@@ -302,7 +358,7 @@ namespace silk
                 if (e.VirtualAddress <= rva && rva <= e.VirtualAddress + e.VirtualSize)
                 {
                     auto off = rva - e.VirtualAddress + e.PointerToRawData;
-                    return raw_istream(file_->getBufferStart() + off, file_->getBufferSize() - off);
+                    return raw_istream(file_->start() + off, file_->size() - off);
                 }
                                        
             }
@@ -315,6 +371,115 @@ namespace silk
             return md_streams_[idx];
         }
         
+        StringRef PEFileReader::GetUTF8String(const MDString &s) const
+        {
+            const raw_istream &is = md_streams_[kStringStream];
+            if (s.offset >= is.size())
+                return StringRef();
+            
+            const char *p = is.start() + s.offset;
+            return StringRef(p, strnlen(p, is.size() - s.offset));
+        }
+        
+        raw_istream PEFileReader::GetBlob(const MDBlob &b) const
+        {
+            raw_istream is = md_streams_[kBlobStream];
+            is.seek(b.offset);
+            if (is.fail())
+                return raw_istream();
+            
+            size_t size = MDLoader::ReadBlobOrUserStringSize(is);
+            if (size > is.remaining_bytes())
+            {
+                error_handler().Error("Blob at %u is out of range.", b.offset);
+                return raw_istream();
+            }
+            return raw_istream(is.pos(), size);
+        }
+        
+        const char *PEFileReader::GetGUID(const MDGUID &g) const
+        {
+            const raw_istream &is = md_streams_[kGUIDStream];
+            if (!g.offset || g.offset * 16 > is.size())
+                return nullptr;
+            return is.start() + (g.offset - 1) * 16;
+        }
+        
+        const char *PEFileReader::GetMvid() const
+        {
+            auto &tbl = GetMDTable<ModuleDefinition>();
+            return tbl.size() ? GetGUID(tbl.get(1).Mvid) : nullptr;
+        }
+        
+        unsigned PEFileReader::GetEntryPointMethodRow() const
+        {
+            // ECMA-335 Partition II, 25.3.3.1
+            static const uint32_t kNativeEntryPoint = 0x10;
+            if (cor20_header_.COR20Flags & kNativeEntryPoint)
+                return 0;
+            
+            // The entry point might be in another file of the assembly
+            MDToken token(cor20_header_.EntryPointTokenOrRVA >> 24, cor20_header_.EntryPointTokenOrRVA);
+            if (token.id() != kMethodDefinition || token.idx() > row_count(kMethodDefinition))
+                return 0;
+            return token.idx();
+        }
+        
+        std::u16string PEFileReader::GetString(const MDString &s) const
+        {
+            auto str = GetUTF8String(s);
+            return ToUTF16String(str.data(), str.size());
+        }
+        
+        std::u16string PEFileReader::GetUserString(const MDToken &token) const
+        {
+            raw_istream is = md_streams_[kUserStringStream];
+            is.seek(token.idx());
+            if (is.fail())
+                return std::u16string();
+            
+            // The trailing byte of each entry is a flag rather than a character
+            size_t size = MDLoader::ReadBlobOrUserStringSize(is);
+            if (size > is.remaining_bytes())
+            {
+                error_handler().Error("User string at %u is out of range.", token.idx());
+                return std::u16string();
+            }
+            return std::u16string(reinterpret_cast<const char16_t*>(is.pos()), size / 2);
+        }
+        
+        template<class Trait>
+        void PEFileReader::InitializeCodedIndexSize()
+        {
+            uint32_t max_rows = 0;
+            for (auto id : Trait::tags)
+            {
+                if (id != kInvalidTableReference)
+                    max_rows = std::max(max_rows, row_count(id));
+            }
+            coded_index_sizes_[Trait::kind] = max_rows < (1u << (16 - Trait::tag_bits)) ? 2 : 4;
+        }
+        
+        void PEFileReader::InitializeIndexSizes()
+        {
+            for (unsigned i = 0; i < kMetadataTableCount; ++i)
+                simple_index_sizes_[i] = row_counts_[i] > 0xffff ? 4 : 2;
+            
+            InitializeCodedIndexSize<TypeDefOrRefTrait>();
+            InitializeCodedIndexSize<HasConstantTrait>();
+            InitializeCodedIndexSize<HasCustomAttributeTrait>();
+            InitializeCodedIndexSize<HasFieldMarshallTrait>();
+            InitializeCodedIndexSize<HasDeclSecurityTrait>();
+            InitializeCodedIndexSize<MemberRefParentTrait>();
+            InitializeCodedIndexSize<HasSemanticsTrait>();
+            InitializeCodedIndexSize<MethodDefOrRefTrait>();
+            InitializeCodedIndexSize<MemberForwardedTrait>();
+            InitializeCodedIndexSize<ImplementationTrait>();
+            InitializeCodedIndexSize<CustomAttributeTypeTrait>();
+            InitializeCodedIndexSize<ResolutionScopeTrait>();
+            InitializeCodedIndexSize<TypeOrMethodDefTrait>();
+        }
+        
         MDTableBase *PEFileReader::table(unsigned idx) const
         {
             auto it = md_tables_.find(idx);
@@ -329,11 +494,11 @@ namespace silk
         AssemblyIdentity PEFileReader::GetAssemblyId() const
         {
             assert(is_assembly());
-            auto r = GetMDTable<AssemblyDefinition>().get(1);
-            return AssemblyIdentity(r.Name, r.Culture, r.MajorVersion, r.MinorVersion, r.RevisionNumber, r.BuildNumber);
+            auto &r = GetMDTable<AssemblyDefinition>().get(1);
+            return AssemblyIdentity(GetString(r.Name), GetString(r.Culture), r.MajorVersion, r.MinorVersion, r.RevisionNumber, r.BuildNumber);
         }
         
-        MethodIL *PEFileReader::GetMethodIL(size_t idx) const
+        MethodIL *PEFileReader::GetMethodIL(size_t idx, Arena *arena) const
         {
             auto &tbl = GetMDTable<MethodDef>();
             if (idx <= 0 || idx > tbl.size())
@@ -350,10 +515,11 @@ namespace silk
             if ((b0 & MethodIL::kFatFormat) == MethodIL::kTinyFormat)
             {
                 auto size = b0 >> MethodIL::kILTinyFormatSizeShift;
-                auto m = new MethodIL();
+                auto m = arena->New<MethodIL>();
                 m->LocalVariablesInited = true;
                 m->MaxStack = 8;
                 m->EncodedILMemoryBlock = raw_istream(is.pos(), size);
+                file_->Advise(is.pos(), size, MappedFile::Advice::kWillNeed);
                 return m;
             }
             
@@ -362,12 +528,13 @@ namespace silk
             is >> b1;
             assert ((b1 >> MethodIL::kILFatFormatHeaderSizeShift) == MethodIL::kILFatFormatHeaderSize);
             
-            auto m = new MethodIL();
+            auto m = arena->New<MethodIL>();
             uint32_t code_size;
 
             m->LocalVariablesInited = (b0 & MethodIL::kInitLocals) == MethodIL::kInitLocals;
             is >> m->MaxStack >> code_size >> m->LocalSignatureToken;
             m->EncodedILMemoryBlock = raw_istream(is.pos(), code_size);
+            file_->Advise(is.pos(), code_size, MappedFile::Advice::kWillNeed);
             
             return m;
         }
@@ -397,6 +564,7 @@ namespace silk
             CreateTable<FieldRVA>();
             CreateTable<AssemblyDefinition>();
             CreateTable<AssemblyRef>();
+            CreateTable<ExportedType>();
             CreateTable<NestedClass>();
             CreateTable<GenericParameter>();
         }
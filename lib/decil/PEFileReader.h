@@ -15,9 +15,12 @@
 #include "silk/decil/Units.h"
 #include "silk/decil/IHost.h"
 #include "silk/Support/raw_istream.h"
+#include "silk/Support/Atom.h"
+#include "silk/Support/MappedFile.h"
+#include "silk/Support/Arena.h"
 
 #include <llvm/ADT/OwningPtr.h>
-#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/ADT/StringRef.h>
 
 #include <string>
 #include <vector>
@@ -162,7 +165,8 @@ namespace silk
         class PEFileReader
         {
         public:
-            PEFileReader(IHost *host, llvm::OwningPtr<llvm::MemoryBuffer> &file);
+            // Errors are reported to eh, or to the host when eh is nullptr
+            PEFileReader(IHost *host, MappedFile *file, ErrorHandler *eh = nullptr);
             
             enum ReaderState
             {
@@ -186,7 +190,40 @@ namespace silk
             
             raw_istream &md_stream(int idx);
             const MetadataTableHeader &mdt_header() const { return mdt_header_; }
+            
+            // Decode the data referred by the heap indices of the metadata
+            llvm::StringRef GetUTF8String(const MDString &s) const;
+            std::u16string GetString(const MDString &s) const;
+            std::u16string GetUserString(const MDToken &token) const;
+            Atom GetAtom(const MDString &s) const
+            { return Atom(GetString(s)); }
+            raw_istream GetBlob(const MDBlob &b) const;
+            // Returns the 16 bytes of the GUID, or nullptr for the null GUID
+            const char *GetGUID(const MDGUID &g) const;
+            // The module version id, which changes every time the module is built
+            const char *GetMvid() const;
+            // The MethodDef row of the managed entry point, or 0 if there
+            // is none, e.g., the file is a library
+            unsigned GetEntryPointMethodRow() const;
 
+            unsigned row_count(unsigned id) const
+            { return id < kMetadataTableCount ? row_counts_[id] : 0; }
+            
+            //
+            // Width of the table indices, ECMA-335 Partition II, 24.2.6.
+            // They only depend on the row counts, thus they are computed
+            // once when the table header is read.
+            //
+            const uint8_t *simple_index_sizes() const { return simple_index_sizes_; }
+            const uint8_t *coded_index_sizes() const { return coded_index_sizes_; }
+            unsigned simple_index_size(unsigned id) const { return simple_index_sizes_[id]; }
+            unsigned coded_index_size(unsigned kind) const { return coded_index_sizes_[kind]; }
+            
+            ErrorHandler &error_handler() const
+            { return *error_handler_; }
+            void set_error_handler(ErrorHandler *eh)
+            { error_handler_ = eh; }
+            
             MDTableBase *table(unsigned id) const;
             template<class T>
             MDTable<T> &GetMDTable() const
@@ -194,9 +231,15 @@ namespace silk
                 return *(static_cast<MDTable<T>*>(table(T::id())));
             }
             
+            const MappedFile &mapped_file() const { return *file_; }
+            // The tables are bound to rows inside the cache file, thus the
+            // reader keeps it mapped.
+            void set_cache_file(MappedFile *cache) { cache_file_.reset(cache); }
+            
             bool is_assembly() const;
             AssemblyIdentity GetAssemblyId() const;
-            MethodIL *GetMethodIL(size_t idx) const;
+            // The header of the body is allocated from arena
+            MethodIL *GetMethodIL(size_t idx, Arena *arena) const;
             raw_istream RVAToIStream(uint32_t rva) const;
 
         private:
@@ -231,7 +274,9 @@ namespace silk
             MetadataHeader metadata_header_;
 
             IHost *host_;
-            llvm::OwningPtr<llvm::MemoryBuffer> file_;
+            ErrorHandler *error_handler_;
+            llvm::OwningPtr<MappedFile> file_;
+            llvm::OwningPtr<MappedFile> cache_file_;
             ReaderState state_;
             
             int ReadPEFileLevelData();
@@ -244,6 +289,7 @@ namespace silk
             void ReadPESectionHeaders(raw_istream &is, ErrorHandler &eh);
             
             void ReadMetadataHeader(raw_istream &is, ErrorHandler &eh);
+            void AdviseMetadataStreams() const;
             
             template<class T>
             void CreateTable()
@@ -251,11 +297,17 @@ namespace silk
                 md_tables_.insert(std::make_pair(T::id(), new MDTable<T>()));
             }
             void InitializeMetadataTables();
+            void InitializeIndexSizes();
+            template<class Trait>
+            void InitializeCodedIndexSize();
             
             raw_istream DirectoryToIStream(const PEDirectoryEntry &e, ErrorHandler &) const;
             
             raw_istream md_streams_[kMetadataStreamCount];
             MetadataTableHeader mdt_header_;
+            uint32_t row_counts_[kMetadataTableCount];
+            uint8_t simple_index_sizes_[kMetadataTableCount];
+            uint8_t coded_index_sizes_[kCodedIndexKindCount];
             typedef std::map<unsigned, MDTableBase*> MDTables;
             MDTables md_tables_;
         };
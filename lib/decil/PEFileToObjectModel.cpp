@@ -14,8 +14,11 @@
 #include "Host.h"
 #include "ILReader.h"
 
+#include "silk/Support/ErrorHandler.h"
 #include "silk/Support/Util.h"
+#include "silk/Support/ThreadPool.h"
 
+#include <algorithm>
 #include <iostream>
 
 namespace silk
@@ -23,19 +26,22 @@ namespace silk
     namespace decil
     {
         PEFileToObjectModel::PEFileToObjectModel(Host *host, PEFileReader *file)
-        : host_(host)
+        : arena_(64 * 1024)
+        , host_(host)
         , file_(file)
+        , type_refs_(file->GetMDTable<TypeRef>().size() + 1)
+        , member_refs_(file->GetMDTable<MemberReference>().size() + 1)
         {
             assert(file->is_assembly());
             auto id = file->GetAssemblyId();
-            containing_assembly_ = new Assembly(this, id);
+            containing_assembly_ = arena_.New<Assembly>(this, id);
 
             fields_.resize(file_->GetMDTable<FieldDef>().size() + 1);
             methods_.resize(file_->GetMDTable<MethodDef>().size() + 1);
-            type_refs_.resize(file_->GetMDTable<TypeRef>().size() + 1);
-            member_refs_.resize(file_->GetMDTable<MemberReference>().size() + 1);
 
+            LoadMemberOwners();
             LoadAssemblyReferences();
+            LoadTypeNameIndex();
             LoadTypeDefinitions();
             
 //            this.LoadModuleReferences();
@@ -88,7 +94,7 @@ namespace silk
             std::u16string res;
             for (auto e : params)
             {
-                res += u"." + e->resolved_type()->name();
+                res += u"." + e->resolved_type()->name().str();
             }
             return res;
         }
@@ -101,45 +107,87 @@ namespace silk
             assembly_references_.push_back(nullptr);
             for (auto &e : tbl)
             {
-                auto id = AssemblyIdentity(e.Name, e.Culture, e.MajorVersion, e.MinorVersion,
+                auto id = AssemblyIdentity(file_->GetString(e.Name), file_->GetString(e.Culture),
+                                           e.MajorVersion, e.MinorVersion,
                                            e.RevisionNumber, e.BuildNumber);
-                auto v = new AssemblyReference(host_, id);
+                auto v = arena_.New<AssemblyReference>(host_, id);
                 assembly_references_.push_back(v);
             }
         }
         
+        void PEFileToObjectModel::LoadMemberOwners()
+        {
+            // The field and method lists of the TypeDef rows are runs
+            // that partition the FieldDef and MethodDef tables, so a
+            // single pass over the TypeDef table finds every owner.
+            auto &tbl = file_->GetMDTable<TypeDefinition>();
+            field_owners_.assign(fields_.size(), 0);
+            method_owners_.assign(methods_.size(), 0);
+            
+            for (size_t i = 1; i < tbl.size() + 1; ++i)
+            {
+                auto &e = tbl.get(i);
+                size_t field_end = fields_.size(), method_end = methods_.size();
+                if (i < tbl.size())
+                {
+                    auto &next = tbl.get(i + 1);
+                    field_end = std::min<size_t>(next.FieldList, field_end);
+                    method_end = std::min<size_t>(next.MethodList, method_end);
+                }
+                
+                for (size_t j = e.FieldList; j < field_end; ++j)
+                    field_owners_[j] = i;
+                for (size_t j = e.MethodList; j < method_end; ++j)
+                    method_owners_[j] = i;
+            }
+        }
+        
+        void PEFileToObjectModel::LoadTypeNameIndex()
+        {
+            auto &typedef_tbl = file_->GetMDTable<TypeDefinition>();
+            auto &exported_tbl = file_->GetMDTable<ExportedType>();
+            type_names_.reserve(typedef_tbl.size() + exported_tbl.size());
+            
+            // Nested types are not visible by their names alone. The keys
+            // point into the mapped #Strings heap, which outlives the model.
+            // Later duplicates never replace the first definition.
+            for (auto &e : typedef_tbl)
+            {
+                if (e.is_nested())
+                    continue;
+                TypeNameKey key = { file_->GetUTF8String(e.TypeNamespace), file_->GetUTF8String(e.TypeName) };
+                type_names_.insert(std::make_pair(key, MDToken(kTypeDefinition, e.index())));
+            }
+            
+            // Only type forwarders, the other modules of a multi-module
+            // assembly are not supported
+            for (auto &e : exported_tbl)
+            {
+                if (e.is_nested() || e.Implementation.id() != kAssemblyReference)
+                    continue;
+                TypeNameKey key = { file_->GetUTF8String(e.TypeNamespace), file_->GetUTF8String(e.TypeName) };
+                type_names_.insert(std::make_pair(key, MDToken(kExportedType, e.index())));
+            }
+        }
+        
         void PEFileToObjectModel::LoadTypeDefinitions()
         {
             auto &tbl = file_->GetMDTable<TypeDefinition>();
             named_typedefs_.resize(tbl.size() + 1);
             auto end = tbl.size() + 1;
-            // Making sure the iterator is valid
+            // Making sure the iterator is valid. The signatures and the
+            // bodies of the methods are loaded on demand.
             for (size_t i = 1; i < end; ++i)
             {
                 GetTypeDefinitionAtRow(i);
             }
-            
-            for (size_t i = 1; i < end; ++i)
-            {
-                auto t = GetTypeDefinitionAtRow(i);
-                for (auto it = t->method_begin(), end = t->method_end(); it != end; ++it)
-                {
-                    auto meth = static_cast<MethodDefinition*>(*it);
-                    LoadMethodDefinition(meth, meth->method_def());
-                    meth->LoadInstructions();
-                }
-            }
         }
         
         unsigned PEFileToObjectModel::FindParentOfNestedClassByRowId(size_t idx)
         {
             auto &tbl = file_->GetMDTable<NestedClass>();
-            for (auto &e : tbl)
-            {
-                if (e.NestedClass == idx)
-                    return e.EnclosingClass;
-            }
-            return 0;
+            auto row = tbl.FindRow(idx, [](const NestedClass &e) { return e.NestedClass.idx(); });
+            return row ? tbl.get(row).EnclosingClass.idx() : 0;
         }
         
         void PEFileToObjectModel::LoadTypeBaseMembers(TypeBase *type)
@@ -175,20 +223,6 @@ namespace silk
                 methods->push_back(CreateMethodDefinitionAtRow(i, type));
         }
         
-        void PEFileToObjectModel::EnsureParentTypeLoaded(int idx, std::function<int(const decil::TypeDefinition&)> idx_func)
-        {
-            auto &tbl = file_->GetMDTable<TypeDefinition>();
-
-            size_t i;
-            for (i = 1; i < tbl.size() + 1; ++i)
-            {
-                auto &e = tbl.get(i);
-                
-                if (idx_func(e) > idx)
-                    break;
-            }
-            GetTypeDefinitionAtRow(i - 1);
-        }
 
         
         AssemblyReference *PEFileToObjectModel::GetAssemblyReferenceAtRow(size_t idx)
@@ -212,18 +246,18 @@ namespace silk
             if (e.is_nested())
             {
                 auto parent_type = FindParentOfNestedClassByRowId(e.index());
-                ret = new NonGenericNestedType(this, &e, parent_type);
+                ret = arena_.New<NonGenericNestedType>(this, &e, parent_type);
             }
             else
             {
                 auto tc = GetTypeCodeForTypeDefAtRow(idx);
                 if (tc == INamedTypeDefinition::TypeCode::NotPrimitive)
                 {
-                    ret = new NonGenericNamespaceType(this, &e);
+                    ret = arena_.New<NonGenericNamespaceType>(this, &e);
                 }
                 else
                 {
-                    ret = new NonGenericNamespaceTypeWithPrimitiveType(this, &e, tc);
+                    ret = arena_.New<NonGenericNamespaceTypeWithPrimitiveType>(this, &e, tc);
                 }
             }
             named_typedefs_[idx] = ret;
@@ -244,7 +278,7 @@ namespace silk
             
             // Load the type lazily
             if (!fields_[idx])
-                EnsureParentTypeLoaded(idx, [](const TypeDefinition &t) { return t.FieldList; });
+                GetTypeDefinitionAtRow(field_owners_[idx]);
 
             return fields_[idx];
         }
@@ -254,7 +288,7 @@ namespace silk
             auto &tbl = file_->GetMDTable<FieldDef>();
             assert (0 < idx && idx <= tbl.size() && !fields_[idx]);
             
-            auto ret = new FieldDefinition(this, &tbl.get(idx), containing_type);
+            auto ret = arena_.New<FieldDefinition>(this, &tbl.get(idx), containing_type);
             fields_[idx] = ret;
             return ret;            
         }
@@ -267,7 +301,7 @@ namespace silk
             
             // Load the type lazily
             if (!methods_[idx])
-                EnsureParentTypeLoaded(idx, [](const TypeDefinition &t) { return t.MethodList; });
+                GetTypeDefinitionAtRow(method_owners_[idx]);
 
             auto ret = methods_[idx];
             assert(ret);
@@ -282,7 +316,7 @@ namespace silk
 //            if (tbl.size() == 691)
 //                std::cout << "&tbl.get(" << idx << "):" << &tbl.get(idx) << "\n";
             
-            auto ret = new MethodDefinition(this, &tbl.get(idx), containing_type);
+            auto ret = arena_.New<MethodDefinition>(this, &tbl.get(idx), containing_type);
             methods_[idx] = ret;
             assert (ret->method_def()->index() == idx);
             return ret;
@@ -294,27 +328,33 @@ namespace silk
             if (idx <= 0 || idx > tbl.size())
                 return nullptr;
             
-            if (type_refs_[idx])
-                return type_refs_[idx];
+            auto ret = type_refs_[idx].load(std::memory_order_acquire);
+            if (ret)
+                return ret;
+            
+            std::lock_guard<std::recursive_mutex> guard(references_lock_);
+            ret = type_refs_[idx].load(std::memory_order_relaxed);
+            if (ret)
+                return ret;
             
             auto &e = tbl.get(idx);
             auto tok = e.ResolutionScope;
-            ITypeReference *ret = NULL;
             switch (tok.id())
             {
                 case kAssemblyReference:
-                    ret = new TypeReference(GetAssemblyReferenceAtRow(tok.idx()), e.TypeName, e.TypeNamespace);
+                    ret = arena_.New<TypeReference>(GetAssemblyReferenceAtRow(tok.idx()),
+                                            file_->GetString(e.TypeName), file_->GetString(e.TypeNamespace));
                     break;
                     
                 default:
                     assert (0 && "Unimplemented");
                     break;
             }
-            type_refs_[idx] = ret;
+            type_refs_[idx].store(ret, std::memory_order_release);
             return ret;
         }
         
-        ITypeReference *PEFileToObjectModel::GetTypeReferenceForToken(const MDTokenBase *tok)
+        ITypeReference *PEFileToObjectModel::GetTypeReferenceForToken(const MDToken *tok)
         {
             auto type = tok->id();
             auto idx = tok->idx();
@@ -333,7 +373,7 @@ namespace silk
             return nullptr;
         }
         
-        IMethodReference *PEFileToObjectModel::GetMethodReferenceForToken(const MDTokenBase *tok)
+        IMethodReference *PEFileToObjectModel::GetMethodReferenceForToken(const MDToken *tok)
         {
             auto type = tok->id();
             auto idx = tok->idx();
@@ -343,7 +383,7 @@ namespace silk
                     return GetMethodDefAtRow(idx);
                     
                 case kMemberReference:
-                    return dynamic_cast<IMethodReference*>(GetMemberReferenceAtRow(idx));
+                    return llvm::cast<IMethodReference>(GetMemberReferenceAtRow(idx));
                     
                 default:
                     assert (0 && "Unimplemented");
@@ -352,7 +392,13 @@ namespace silk
             return nullptr;
         }
         
-        IFieldReference *PEFileToObjectModel::GetFieldReferenceForToken(const MDTokenBase *tok)
+        IMethodDefinition *PEFileToObjectModel::GetEntryPoint()
+        {
+            auto row = file_->GetEntryPointMethodRow();
+            return row ? GetMethodDefAtRow(row) : nullptr;
+        }
+        
+        IFieldReference *PEFileToObjectModel::GetFieldReferenceForToken(const MDToken *tok)
         {
             auto type = tok->id();
             auto idx = tok->idx();
@@ -362,7 +408,7 @@ namespace silk
                     return GetFieldDefAtRow(idx);
                     
                 case kMemberReference:
-                    return dynamic_cast<IFieldReference*>(GetMemberReferenceAtRow(idx));
+                    return llvm::cast<IFieldReference>(GetMemberReferenceAtRow(idx));
                     
                 default:
                     assert (0 && "Unimplemented");
@@ -377,14 +423,18 @@ namespace silk
             if (idx <= 0 || idx > tbl.size())
                 return nullptr;
             
-            if (member_refs_[idx])
-                return member_refs_[idx];
+            auto ret = member_refs_[idx].load(std::memory_order_acquire);
+            if (ret)
+                return ret;
+            
+            std::lock_guard<std::recursive_mutex> guard(references_lock_);
+            ret = member_refs_[idx].load(std::memory_order_relaxed);
+            if (ret)
+                return ret;
             
             auto &e = tbl.get(idx);
             auto type_id = e.Class.id();
             
-            ITypeMemberReference *ret = nullptr;
-            
             if (type_id == kTypeDefinition || type_id == kTypeReference)
             {
                 ITypeReference *parent = nullptr;
@@ -397,15 +447,15 @@ namespace silk
                     parent = GetTypeReferenceAtRow(e.Class.idx());
                 }
                 
-                auto is = e.Signature.to_istream();
+                auto is = file_->GetBlob(e.Signature);
                 uint8_t first_byte = is.peek<uint8_t>();
                 if (SignatureConverter::IsFieldSignature(first_byte))
                 {
-                    ret = new FieldReference(this, &e, parent);
+                    ret = arena_.New<FieldReference>(this, &e, parent);
                 }
                 else if (SignatureConverter::IsMethodSignature(first_byte))
                 {
-                    ret = new MethodReference(this, &e, parent);
+                    ret = arena_.New<MethodReference>(this, &e, parent);
                 }
                 else
                 {
@@ -421,34 +471,34 @@ namespace silk
                 assert (0 && "unimplemented");
             }
 
-            member_refs_[idx] = ret;
+            member_refs_[idx].store(ret, std::memory_order_release);
             return ret;
         }
         
         INamedTypeDefinition::TypeCode PEFileToObjectModel::GetTypeCodeForTypeDefAtRow(size_t idx) const
         {
-            static struct
+            static const struct
             {
-                std::u16string ns;
-                std::u16string name;
+                const char *ns;
+                const char *name;
                 INamedTypeDefinition::TypeCode code;
             } core_types[] =
             {
-                {u"System", u"Void", INamedTypeDefinition::TypeCode::Void},
-                {u"System", u"Boolean", INamedTypeDefinition::TypeCode::Boolean},
-                {u"System", u"Char", INamedTypeDefinition::TypeCode::Char},
-                {u"System", u"SByte", INamedTypeDefinition::TypeCode::Int8},
-                {u"System", u"Byte", INamedTypeDefinition::TypeCode::UInt8},
-                {u"System", u"Int16", INamedTypeDefinition::TypeCode::Int16},
-                {u"System", u"UInt16", INamedTypeDefinition::TypeCode::UInt16},
-                {u"System", u"Int32", INamedTypeDefinition::TypeCode::Int32},
-                {u"System", u"UInt32", INamedTypeDefinition::TypeCode::UInt32},
-                {u"System", u"Int64", INamedTypeDefinition::TypeCode::Int64},
-                {u"System", u"UInt64", INamedTypeDefinition::TypeCode::UInt64},
-                {u"System", u"Single", INamedTypeDefinition::TypeCode::Single},
-                {u"System", u"Double", INamedTypeDefinition::TypeCode::Double},
-                {u"System", u"IntPtr", INamedTypeDefinition::TypeCode::IntPtr},
-                {u"System", u"UIntPtr", INamedTypeDefinition::TypeCode::UIntPtr},
+                {"System", "Void", INamedTypeDefinition::TypeCode::Void},
+                {"System", "Boolean", INamedTypeDefinition::TypeCode::Boolean},
+                {"System", "Char", INamedTypeDefinition::TypeCode::Char},
+                {"System", "SByte", INamedTypeDefinition::TypeCode::Int8},
+                {"System", "Byte", INamedTypeDefinition::TypeCode::UInt8},
+                {"System", "Int16", INamedTypeDefinition::TypeCode::Int16},
+                {"System", "UInt16", INamedTypeDefinition::TypeCode::UInt16},
+                {"System", "Int32", INamedTypeDefinition::TypeCode::Int32},
+                {"System", "UInt32", INamedTypeDefinition::TypeCode::UInt32},
+                {"System", "Int64", INamedTypeDefinition::TypeCode::Int64},
+                {"System", "UInt64", INamedTypeDefinition::TypeCode::UInt64},
+                {"System", "Single", INamedTypeDefinition::TypeCode::Single},
+                {"System", "Double", INamedTypeDefinition::TypeCode::Double},
+                {"System", "IntPtr", INamedTypeDefinition::TypeCode::IntPtr},
+                {"System", "UIntPtr", INamedTypeDefinition::TypeCode::UIntPtr},
             };
 
             auto &tbl = file_->GetMDTable<TypeDefinition>();
@@ -461,8 +511,8 @@ namespace silk
             }
             
             auto &e = tbl.get(idx);
-            auto ns = (std::u16string)e.TypeNamespace;
-            auto n = (std::u16string)e.TypeName;
+            auto ns = file_->GetUTF8String(e.TypeNamespace);
+            auto n = file_->GetUTF8String(e.TypeName);
             
             for (auto &c : core_types)
             {
@@ -475,27 +525,47 @@ namespace silk
         
         INamedTypeDefinition *PEFileToObjectModel::ResolveNamespaceTypeDefinition(const std::u16string &namespace_name, const std::u16string &name)
         {
-//            std::wstring_convert<std::codecvt_utf8_utf16<char16_t>, char16_t> utf16conv;
-//            std::cout << "Resolve:" << utf16conv.to_bytes(namespace_name + u"." + name) << "\n";
-//            
-            auto &tbl = file_->GetMDTable<TypeDefinition>();
-            for (auto &e : tbl)
+            return ResolveNamespaceTypeDefinition(namespace_name, name, 0);
+        }
+        
+        INamedTypeDefinition *PEFileToObjectModel::ResolveNamespaceTypeDefinition(const std::u16string &namespace_name, const std::u16string &name, unsigned forwards)
+        {
+            auto u8_namespace_name = ToUTF8String(namespace_name);
+            auto u8_name = ToUTF8String(name);
+            TypeNameKey key = { u8_namespace_name, u8_name };
+            
+            auto it = type_names_.find(key);
+            if (it == type_names_.end())
+                return nullptr;
+            
+            auto tok = it->second;
+            if (tok.id() == kTypeDefinition)
+                return GetTypeDefinitionAtRow(tok.idx());
+            
+            // A chain this long can only be a cycle, e.g., A -> B -> A
+            if (forwards >= kMaxTypeForwards)
             {
-//                std::cout << utf16conv.to_bytes((std::u16string)e.TypeNamespace + u"." + (std::u16string)e.TypeName) << "\n";
-
-                if ((std::u16string)e.TypeNamespace == namespace_name
-                    && (std::u16string)e.TypeName == name)
-                    return GetTypeDefinitionAtRow(e.index());
+                file_->error_handler().Error("Type `%s.%s' is forwarded in a cycle.", u8_namespace_name.c_str(), u8_name.c_str());
+                return nullptr;
             }
-            return nullptr;
+            
+            // Type forwarder, ECMA-335 Partition II, 6.8
+            auto &e = file_->GetMDTable<ExportedType>().get(tok.idx());
+            assert (e.Implementation.id() == kAssemblyReference);
+            auto ref = GetAssemblyReferenceAtRow(e.Implementation.idx());
+            auto assembly = ref ? static_cast<Assembly*>(ref->ResolvedAssembly()) : nullptr;
+            if (!assembly)
+                return nullptr;
+            return assembly->model()->ResolveNamespaceTypeDefinition(namespace_name, name, forwards + 1);
         }
         
-        void PEFileToObjectModel::LoadMethodDefinition(MethodDefinition *method, const MethodDef *def)
+        void PEFileToObjectModel::LoadMethodSignature(MethodDefinition *method)
         {
-            auto signature = def->Signature.to_istream();
-            MethodSignatureConverter converter(this, signature);
-            method->signature_flags_ = converter.flags();
-            method->return_type_ = converter.return_type();
+            auto def = method->method_def();
+            auto signature = file_->GetBlob(def->Signature);
+            auto converter = GetMethodSignature(signature);
+            method->signature_flags_ = converter->flags();
+            method->return_type_ = converter->return_type();
             
             auto &method_tbl = file_->GetMDTable<MethodDef>();
             auto &param_tbl = file_->GetMDTable<ParamDef>();
@@ -507,12 +577,15 @@ namespace silk
                 param_end = next.ParamList;
             }
             
-            auto &params = converter.param_type();
+            auto &params = converter->param_type();
             
-            auto has_implicit_this = method->has_this() && !method->explicit_this();
+            // has_this() would wait for the signature that is being loaded
+            auto flags = method->signature_flags_;
+            auto has_implicit_this = (flags & SignatureConverter::kHasThis) && !(flags & SignatureConverter::kExplicitThis);
             if (has_implicit_this)
             {
-                auto this_param = new ParameterDefinition(this, u"this", method->containing_type());
+                static const Atom this_name(u"this");
+                auto this_param = arena_.New<ParameterDefinition>(this, this_name, method->containing_type());
                 method->params_.push_back(this_param);
             }
 
@@ -523,12 +596,92 @@ namespace silk
                 // Don't push the return type into the parameter list
                 if (p.Sequence != 0)
                 {
-                    auto param_def = new ParameterDefinition(this, p.Name, params.at(p.Sequence - 1));
+                    auto param_def = arena_.New<ParameterDefinition>(this, file_->GetAtom(p.Name), params.at(p.Sequence - 1));
                     method->params_.push_back(param_def);
                 }
             }
+        }
+        
+        const MethodSignatureConverter *PEFileToObjectModel::GetMethodSignature(const raw_istream &signature)
+        {
+            {
+                std::lock_guard<std::mutex> guard(signatures_lock_);
+                auto it = method_signatures_.find(signature.start());
+                if (it != method_signatures_.end())
+                    return it->second;
+            }
             
-            auto method_il = file_->GetMethodIL(def->index());
+            // Two threads might decode the same signature, the first one
+            // that finishes is kept.
+            auto converter = arena_.New<MethodSignatureConverter>(this, signature);
+            std::lock_guard<std::mutex> guard(signatures_lock_);
+            return method_signatures_.insert(std::make_pair(signature.start(), converter)).first->second;
+        }
+        
+        ITypeReference *PEFileToObjectModel::GetFieldType(const raw_istream &signature)
+        {
+            {
+                std::lock_guard<std::mutex> guard(signatures_lock_);
+                auto it = field_types_.find(signature.start());
+                if (it != field_types_.end())
+                    return it->second;
+            }
+            
+            FieldSignatureConverter converter(this, signature);
+            std::lock_guard<std::mutex> guard(signatures_lock_);
+            return field_types_.insert(std::make_pair(signature.start(), converter.resolved_type())).first->second;
+        }
+        
+        void PEFileToObjectModel::LoadReferences()
+        {
+            // Only the kinds of references that the model supports, the
+            // others would stop at the same assertions when they are used.
+            auto &typeref_tbl = file_->GetMDTable<TypeRef>();
+            auto is_supported_type_ref = [&typeref_tbl](size_t idx) {
+                return typeref_tbl.get(idx).ResolutionScope.id() == kAssemblyReference;
+            };
+            
+            for (auto &e : typeref_tbl)
+            {
+                if (is_supported_type_ref(e.index()))
+                    GetTypeReferenceAtRow(e.index());
+            }
+            
+            for (auto &e : file_->GetMDTable<MemberReference>())
+            {
+                auto id = e.Class.id();
+                if (id == kTypeDefinition || id == kMethodDefinition
+                    || (id == kTypeReference && is_supported_type_ref(e.Class.idx())))
+                    GetMemberReferenceAtRow(e.index());
+            }
+        }
+        
+        void PEFileToObjectModel::LoadMethods(ThreadPool *pool)
+        {
+            LoadReferences();
+            
+            // Small chunks keep the workers busy, the bodies vary in size
+            auto &eh = file_->error_handler();
+            pool->ParallelFor(methods_.size() - 1, 16, [this, &eh](size_t begin, size_t end) {
+                // The errors are reported in the order of the methods
+                ErrorHandler::DeferredScope scope(eh, begin);
+                for (size_t i = begin + 1; i < end + 1; ++i)
+                {
+                    if (methods_[i])
+                        methods_[i]->LoadBody();
+                }
+            });
+            eh.FlushDeferred();
+        }
+        
+        void PEFileToObjectModel::LoadMethodBody(MethodDefinition *method)
+        {
+            auto def = method->method_def();
+            // Everything that is only needed to compile the body comes from
+            // an arena of its own, see MethodDefinition::ReleaseBody().
+            auto arena = new Arena(1024);
+            method->body_arena_.reset(arena);
+            auto method_il = file_->GetMethodIL(def->index(), arena);
             method->method_il_ = method_il;
             if (method_il)
             {
@@ -537,7 +690,7 @@ namespace silk
                 {
                     auto &tbl = file_->GetMDTable<StandAloneSignature>();
                     auto &e = tbl.get(method_il->LocalSignatureToken.idx());
-                    LocalVariableSignatureConverter converter(this, e.Signature.to_istream());
+                    LocalVariableSignatureConverter converter(this, file_->GetBlob(e.Signature), arena);
                     method->locals_.swap(converter.locals());
                 }
             }
@@ -545,33 +698,30 @@ namespace silk
         
         raw_istream PEFileToObjectModel::GetFieldMapping(const FieldDef *field_def)
         {
-            auto field_idx = field_def->index();
-            auto &field_rva_tbl = file_->GetMDTable<FieldRVA>();
-            auto it = std::find_if (field_rva_tbl.begin(), field_rva_tbl.end(),
-                                    [=](const FieldRVA &e) { return e.Field == field_idx; });
+            auto &tbl = file_->GetMDTable<FieldRVA>();
+            auto row = tbl.FindRow(field_def->index(), [](const FieldRVA &e) { return e.Field.idx(); });
             
-            if (it == field_rva_tbl.end())
+            if (!row)
             {
                 return raw_istream();
             }
             else
             {
-                return file_->RVAToIStream(it->RVA);
+                return file_->RVAToIStream(tbl.get(row).RVA);
             }
         }
         
         void PEFileToObjectModel::GetClassLayout(const TypeDefinition *type_def,
                                                  uint32_t *packing_size, uint32_t * class_size)
         {
-            unsigned idx = type_def->index();
             auto &tbl = file_->GetMDTable<ClassLayout>();
-            auto it = std::find_if (tbl.begin(), tbl.end(),
-                                    [=](const ClassLayout &e) { return e.Parent == idx; });
+            auto row = tbl.FindRow(type_def->index(), [](const ClassLayout &e) { return e.Parent.idx(); });
             
-            if (it != tbl.end())
+            if (row)
             {
-                *packing_size = it->PackingSize;
-                *class_size = it->ClassSize;
+                auto &e = tbl.get(row);
+                *packing_size = e.PackingSize;
+                *class_size = e.ClassSize;
             }
             else
             {
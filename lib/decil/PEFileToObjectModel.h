@@ -12,7 +12,13 @@
 #include "BinaryObjectModel.h"
 #include "MetadataTable.h"
 
-#include <functional>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/ADT/Hashing.h>
+
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
 
 namespace silk
 {
@@ -20,7 +26,12 @@ namespace silk
     {
         class PEFileReader;
         class MethodDefinition;
+        class MethodSignatureConverter;
         class Host;
+    }
+    class ThreadPool;
+    namespace decil
+    {
         
         class PEFileToObjectModel
         {
@@ -33,32 +44,89 @@ namespace silk
             { return host_; }
             PEFileReader *file()
             { return file_; }
+            // Owns the objects of the model except the method bodies
+            Arena &arena()
+            { return arena_; }
             
             static std::u16string MangleParams(const std::vector<ITypeReference*> &params);
             INamedTypeDefinition *GetTypeDefinitionAtRow(size_t idx);
-            ITypeReference *GetTypeReferenceForToken(const MDTokenBase *tok);
-            IMethodReference *GetMethodReferenceForToken(const MDTokenBase *tok);
-            IFieldReference *GetFieldReferenceForToken(const MDTokenBase *tok);
+            ITypeReference *GetTypeReferenceForToken(const MDToken *tok);
+            IMethodReference *GetMethodReferenceForToken(const MDToken *tok);
+            IFieldReference *GetFieldReferenceForToken(const MDToken *tok);
+            IMethodDefinition *GetEntryPoint();
+            // The AssemblyRef rows, from zero
+            AssemblyReference *GetAssemblyReference(size_t idx)
+            { return assembly_references_[idx + 1]; }
+            size_t assembly_reference_size() const
+            { return assembly_references_.size() - 1; }
             INamedTypeDefinition *ResolveNamespaceTypeDefinition(const std::u16string &namespace_name, const std::u16string &name);
-            void LoadMethodDefinition(MethodDefinition *method, const MethodDef *def);
+            // Called by MethodDefinition when they are first accessed
+            void LoadMethodSignature(MethodDefinition *method);
+            //
+            // A signature in the #Blob heap is shared by all definitions and
+            // references that have the same one, thus each of them is
+            // decoded once and looked up by its offset afterwards.
+            //
+            const MethodSignatureConverter *GetMethodSignature(const raw_istream &signature);
+            ITypeReference *GetFieldType(const raw_istream &signature);
+            void LoadMethodBody(MethodDefinition *method);
+            //
+            // Decodes the signatures and the bodies of all methods on the
+            // pool. The references that they can refer to are created
+            // beforehand, thus the workers only read the model and each
+            // method is decoded exactly as it would be on first access.
+            //
+            void LoadMethods(ThreadPool *pool);
             raw_istream GetFieldMapping(const FieldDef *field_def);
             void GetClassLayout(const TypeDefinition *type_def, uint32_t *packing_size, uint32_t * class_size);
         private:
+            Arena arena_;
             Host *host_;
             Assembly *containing_assembly_;
             PEFileReader *file_;
             
             std::vector<AssemblyReference*> assembly_references_;
             std::vector<INamedTypeDefinition*> named_typedefs_;
-            std::vector<ITypeReference*> type_refs_;
             std::vector<FieldDefinition*> fields_;
             std::vector<MethodDefinition*> methods_;
-            std::vector<ITypeMemberReference*> member_refs_;
+            // The references are created on first use by any thread, and
+            // are read without the lock once they have been published.
+            std::recursive_mutex references_lock_;
+            std::vector<std::atomic<ITypeReference*> > type_refs_;
+            std::vector<std::atomic<ITypeMemberReference*> > member_refs_;
+            // TypeDef row that owns each FieldDef / MethodDef row
+            std::vector<uint32_t> field_owners_;
+            std::vector<uint32_t> method_owners_;
+            
+            // Top-level types of the assembly keyed by their UTF-8 names
+            // in the #Strings heap. The value is either a TypeDef or the
+            // ExportedType token of a type forwarder.
+            struct TypeNameKey
+            {
+                llvm::StringRef namespace_name;
+                llvm::StringRef name;
+                bool operator==(const TypeNameKey &rhs) const
+                { return namespace_name == rhs.namespace_name && name == rhs.name; }
+            };
+            struct TypeNameKeyHash
+            {
+                size_t operator()(const TypeNameKey &k) const
+                { return llvm::hash_combine(k.namespace_name, k.name); }
+            };
+            std::unordered_map<TypeNameKey, MDToken, TypeNameKeyHash> type_names_;
+            
+            std::mutex signatures_lock_;
+            std::unordered_map<const char*, const MethodSignatureConverter*> method_signatures_;
+            std::unordered_map<const char*, ITypeReference*> field_types_;
             
+            void LoadMemberOwners();
+            void LoadTypeNameIndex();
+            static const unsigned kMaxTypeForwards = 16;
+            INamedTypeDefinition *ResolveNamespaceTypeDefinition(const std::u16string &namespace_name, const std::u16string &name, unsigned forwards);
             void LoadAssemblyReferences();
             void LoadTypeDefinitions();
             void LoadTypeBaseMembers(TypeBase *type);
-            void EnsureParentTypeLoaded(int idx, std::function<int(const decil::TypeDefinition&)> func);
+            void LoadReferences();
             
             unsigned FindParentOfNestedClassByRowId(size_t idx);
             
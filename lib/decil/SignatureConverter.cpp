@@ -77,10 +77,10 @@ namespace silk
                     
                 case kElementTypePointer:
                 case kElementTypeByReference:
-                    return new PointerType(ReadType(is));
+                    return host->GetPointerType(ReadType(is));
                     
                 case kElementTypeSingleDimensionArray:
-                    return new VectorType(ReadType(is));
+                    return host->GetVectorType(ReadType(is));
                     
                 default:
                     assert (0 && "Unimplemented");
@@ -119,7 +119,8 @@ namespace silk
         }
         
         LocalVariableSignatureConverter::LocalVariableSignatureConverter(PEFileToObjectModel *model,
-                                                                         const raw_istream &signature)
+                                                                         const raw_istream &signature,
+                                                                         Arena *arena)
         : SignatureConverter(model)
         {
             auto is = signature;
@@ -138,7 +139,7 @@ namespace silk
                     is.skip(1);
                 }
                 
-                locals_.push_back(new LocalDefinition(is_pinned, ReadType(is)));
+                locals_.push_back(arena->New<LocalDefinition>(is_pinned, ReadType(is)));
             }
         }
     }
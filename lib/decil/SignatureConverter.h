@@ -10,6 +10,7 @@
 #define SILK_LIB_DECIL_SIGNATURE_CONVERTER_H_
 
 #include "silk/Support/raw_istream.h"
+#include "silk/Support/Arena.h"
 
 #include <vector>
 
@@ -114,7 +115,7 @@ namespace silk
         {
         public:
             FieldSignatureConverter(PEFileToObjectModel *model, const raw_istream &signature);
-            ITypeReference *resolved_type()
+            ITypeReference *resolved_type() const
             { return resolved_type_; }
             
         private:
@@ -125,7 +126,7 @@ namespace silk
         {
         public:
             MethodSignatureConverter(PEFileToObjectModel *model, const raw_istream &signature);
-            ITypeReference *return_type()
+            ITypeReference *return_type() const
             { return return_type_; }
             
             uint8_t flags() const
@@ -150,7 +151,9 @@ namespace silk
         class LocalVariableSignatureConverter : private SignatureConverter
         {
         public:
-            LocalVariableSignatureConverter(PEFileToObjectModel *model, const raw_istream &signature);
+            // The locals are allocated from arena, the types they refer to
+            // belong to the model.
+            LocalVariableSignatureConverter(PEFileToObjectModel *model, const raw_istream &signature, Arena *arena);
             std::vector<ILocalDefinition*> &locals()
             { return locals_; }
             
@@ -30,7 +30,7 @@ IF(LLVM_FOUND)
     )
 
   EXECUTE_PROCESS(
-    COMMAND ${LLVM_CONFIG_EXECUTABLE} --libs core bitwriter support
+    COMMAND ${LLVM_CONFIG_EXECUTABLE} --libs core bitreader bitwriter linker transformutils support
     OUTPUT_VARIABLE LLVM_LIBS
     OUTPUT_STRIP_TRAILING_WHITESPACE
     )
@@ -8,7 +8,10 @@
 //
 
 #include "silk/decil/IHost.h"
+#include "silk/decil/ObjectModel.h"
 #include "silk/VMCore/VMModel.h"
+#include "silk/Support/MappedFile.h"
+#include "silk/Support/Util.h"
 //#include "silk/Target/TargetInfo.h"
 //#include "silk/Support/ErrorHandler.h"
 //
@@ -26,12 +29,35 @@
 #include <llvm/Support/ToolOutputFile.h>
 #include <llvm/Support/system_error.h>
 
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
 using namespace llvm;
 using namespace silk;
 
 static cl::list<std::string>
 ClassPaths("classpath", cl::desc("<class path>"));
 
+static cl::opt<std::string>
+MetadataCache("metadata-cache", cl::desc("Directory of the cached metadata of the assemblies"),
+              cl::value_desc("directory"));
+
+static cl::opt<std::string>
+UnitDir("unit-dir", cl::desc("Compile the input and the assemblies that it refers to into a module each, "
+                             "and skip the ones whose builds have not changed"),
+        cl::value_desc("directory"));
+
+static cl::opt<bool>
+WholeProgram("whole-program", cl::desc("Compile only the methods that are reachable from the entry point and the roots"),
+             cl::init(false));
+
+static cl::list<std::string>
+Roots("root", cl::desc("Type or Type::Method that -whole-program keeps, e.g., for a library"),
+      cl::value_desc("name"));
+
 static cl::opt<std::string>
 TargetTriple("target-triple", cl::desc("<target description>"));
 
@@ -44,11 +70,153 @@ OutputFilename("o", cl::desc("Output filename"), cl::value_desc("filename"));
 static cl::opt<bool>
 DisableVerify("disable-verify", cl::desc("Do not run verify pass"), cl::init(false));
 
+static cl::opt<bool>
+ParallelLoad("parallel-load", cl::desc("Decode the method bodies on all cores when loading assemblies"), cl::init(false));
+
+static cl::opt<bool>
+PrintLoadStats("load-stats", cl::desc("Print page faults taken while loading and compiling"), cl::init(false));
+
+static cl::opt<unsigned>
+CodegenShards("codegen-shards", cl::desc("Generate the code into this many modules in parallel, and link them at the end"),
+              cl::init(0));
+
+static cl::opt<unsigned>
+CodegenThreads("codegen-threads", cl::desc("Number of threads for -codegen-shards (default: one per core)"),
+               cl::init(0));
+
+static cl::opt<std::string>
+CodeCacheDir("code-cache", cl::desc("Directory of the code of the methods that are reused across compilations"),
+             cl::value_desc("directory"));
+
+static void ReportPageFaults(decil::IHost *host, const char *phase, const PageFaultCount &start)
+{
+    auto now = PageFaultCount::Current();
+    host->error_handler().Info("%s: %ld minor / %ld major page faults.", phase,
+                               now.minor - start.minor, now.major - start.major);
+}
+
 namespace silk
 {
     Pass *CreateRuntimeHelperFixupPass(IIntrinsic *intrinsic);
 }
 
+static ICompilationEngine *CreateEngine(decil::IHost *host, LLVMContext &context)
+{
+    auto engine = CreateCompilationEngine(host, TargetTriple, context);
+    engine->set_intrinsic(CreateAOTIntrinsic(engine->module()));
+    engine->SetParallelCodegen(CodegenShards, CodegenThreads);
+    if (!CodeCacheDir.empty())
+        engine->SetCodeCache(CodeCacheDir);
+    return engine;
+}
+
+static void Compile(decil::IHost *host, ICompilationEngine *engine, raw_ostream &os)
+{
+    auto compile_start = PageFaultCount::Current();
+    engine->Compile();
+    if (PrintLoadStats)
+        ReportPageFaults(host, "compile", compile_start);
+    
+    auto m = engine->module();
+    PassManager Passes;
+    //
+    //    if (!DisableVerify)
+    Passes.add(createVerifierPass());
+    Passes.add(CreateRuntimeHelperFixupPass(engine->intrinsic()));
+    Passes.add(createBitcodeWriterPass(os));
+
+    Passes.run(*m);
+}
+
+// The assembly and the ones that it refers to, directly or not. The
+// assembly has to be loaded, main() reports the ones that are missing.
+static std::vector<decil::IAssembly*> GetReferenceClosure(decil::IAssembly *assembly)
+{
+    assert (assembly);
+    std::vector<decil::IAssembly*> r(1, assembly);
+    for (size_t i = 0; i < r.size(); ++i)
+    {
+        for (size_t j = 0; j < r[i]->assembly_reference_size(); ++j)
+        {
+            auto ref = r[i]->get_assembly_reference(j)->ResolvedAssembly();
+            if (ref && std::find(r.begin(), r.end(), ref) == r.end())
+                r.push_back(ref);
+        }
+    }
+    return r;
+}
+
+//
+// The code of a unit depends on the target and on the layouts of the types
+// of the unit and of the assemblies that it refers to, thus the stamp lists
+// the MVIDs of all of them. Returns an empty string if one of them has no
+// MVID.
+//
+static std::string GetUnitStamp(decil::IAssembly *unit)
+{
+    std::string stamp = "silk-unit 1\n" + TargetTriple + "\n";
+    for (auto assembly : GetReferenceClosure(unit))
+    {
+        auto mvid = assembly->mvid();
+        if (!mvid)
+            return std::string();
+        
+        char hex[33];
+        for (int i = 0; i < 16; ++i)
+            snprintf(hex + i * 2, 3, "%02x", static_cast<uint8_t>(mvid[i]));
+        stamp += hex;
+        stamp += " " + ToUTF8String(assembly->identity().name()) + "\n";
+    }
+    return stamp;
+}
+
+static bool IsUpToDate(const std::string &path, const std::string &stamp)
+{
+    ErrorHandler eh(true);
+    OwningPtr<MappedFile> code(MappedFile::Open(path + ".bc", eh));
+    OwningPtr<MappedFile> file(MappedFile::Open(path + ".stamp", eh));
+    return !stamp.empty() && code && file && file->size() == stamp.size()
+    && !memcmp(file->start(), stamp.data(), stamp.size());
+}
+
+static int CompileUnits(decil::IHost *host, decil::IAssembly *assembly)
+{
+    auto units = GetReferenceClosure(assembly);
+    if (host->error_handler().has_error())
+        return 1;
+    
+    for (auto unit : units)
+    {
+        auto path = UnitDir + "/" + ToUTF8String(unit->identity().name());
+        auto stamp = GetUnitStamp(unit);
+        if (IsUpToDate(path, stamp))
+            continue;
+        
+        // A context of its own names the types the same way whichever
+        // units have been compiled before
+        LLVMContext context;
+        auto engine = CreateEngine(host, context);
+        engine->SetCompilationUnit(unit);
+        std::string bitcode;
+        {
+            raw_string_ostream os(bitcode);
+            Compile(host, engine, os);
+        }
+        // Before the context, which owns the module of the engine
+        delete engine;
+        
+        // The stamp is written last, thus a unit that has not been written
+        // completely is compiled again
+        if (!WriteFileAtomically(path + ".bc", bitcode.data(), bitcode.size())
+            || !WriteFileAtomically(path + ".stamp", stamp.data(), stamp.size()))
+        {
+            host->error_handler().Error("Cannot write unit `%s': %s.", path.c_str(), strerror(errno));
+            return 1;
+        }
+    }
+    return 0;
+}
+
 int main(int argc, const char * argv[])
 {
     sys::PrintStackTraceOnErrorSignal();
@@ -56,15 +224,24 @@ int main(int argc, const char * argv[])
     cl::ParseCommandLineOptions(argc, argv, "MSIL AOT compiler\n");
     
     llvm_shutdown_obj Y;  // Call llvm_shutdown() on exit.
-    OwningPtr<tool_output_file> Out;
-    std::string ErrorInfo;
-    Out.reset(new tool_output_file(OutputFilename.c_str(), ErrorInfo,
-                                   raw_fd_ostream::F_Binary));
-    if (!ErrorInfo.empty())
+    if (!UnitDir.empty() && (WholeProgram || !OutputFilename.empty()))
     {
-        errs() << ErrorInfo << '\n';
+        errs() << "-unit-dir cannot be used with -whole-program or -o\n";
         return 1;
     }
+    
+    OwningPtr<tool_output_file> Out;
+    if (UnitDir.empty())
+    {
+        std::string ErrorInfo;
+        Out.reset(new tool_output_file(OutputFilename.c_str(), ErrorInfo,
+                                       raw_fd_ostream::F_Binary));
+        if (!ErrorInfo.empty())
+        {
+            errs() << ErrorInfo << '\n';
+            return 1;
+        }
+    }
 //
 //    ErrorHandler eh;
 //
@@ -78,8 +255,14 @@ int main(int argc, const char * argv[])
     decil::IHost *host = decil::CreateDefaultHost();
     for (size_t i = 0; i < ClassPaths.size(); ++i)
         host->AddClassPath(ClassPaths[i]);
+    if (!MetadataCache.empty())
+        host->SetMetadataCache(MetadataCache);
+    host->SetParallelLoad(ParallelLoad);
     
-    host->LoadAssembly(InputFilename);
+    auto load_start = PageFaultCount::Current();
+    auto assembly = host->LoadAssembly(InputFilename);
+    if (PrintLoadStats)
+        ReportPageFaults(host, "load", load_start);
     
     if (host->error_handler().has_error())
     {
@@ -87,20 +270,33 @@ int main(int argc, const char * argv[])
         return 1;
     }
     
-    auto compilation_engine = CreateCompilationEngine(host, TargetTriple);
-    auto aot_intrinsic = CreateAOTIntrinsic(compilation_engine->module());
-    compilation_engine->set_intrinsic(aot_intrinsic);
-    compilation_engine->Compile();
+    // A file outside of the class paths, or one that is not an assembly,
+    // is not loaded without any error
+    if (!assembly)
+    {
+        host->error_handler().Error("Cannot find assembly `%s'.", InputFilename.c_str());
+        return 1;
+    }
     
-    auto m = compilation_engine->module();
-    PassManager Passes;
-    //
-    //    if (!DisableVerify)
-    Passes.add(createVerifierPass());
-    Passes.add(CreateRuntimeHelperFixupPass(aot_intrinsic));
-    Passes.add(createBitcodeWriterPass(Out->os()));
-
-    Passes.run(*m);
+    if (!UnitDir.empty())
+        return CompileUnits(host, assembly);
+    
+    auto compilation_engine = CreateEngine(host, getGlobalContext());
+    if (WholeProgram)
+    {
+        if (!assembly->entry_point() && Roots.empty())
+        {
+            host->error_handler().Error("`%s' has no entry point, specify -root.", InputFilename.c_str());
+            return 1;
+        }
+        
+        std::vector<std::string> roots(Roots.begin(), Roots.end());
+        compilation_engine->SetWholeProgram(assembly, roots);
+        if (host->error_handler().has_error())
+            return 1;
+    }
+    
+    Compile(host, compilation_engine, Out->os());
     Out->keep();
     
     return 0;